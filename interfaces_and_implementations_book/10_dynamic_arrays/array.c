@@ -27,9 +27,17 @@
  * Array.
  */
 
+#define _GNU_SOURCE // mremap
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "assert.h"
+#include "except.h"
 #include "array.h"
 #include "arrayrep.h"
 #include "mem.h"
@@ -41,11 +49,162 @@
 
 #define T Array_T
 
+// Element storage is aligned on a cache line so the bulk operations below
+// start every pass on a line boundary
+#define ALIGN 64
+
+
+//////////
+// data //
+//////////
+
+const Except_T Array_Failed = { "Array Mapping Failed" };
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the length of the mapping that backs capacity elements of size bytes,
+ * rounded up to a whole number of pages
+ */
+static long mapsize (int capacity, int size) {
+	static long pagesize;
+
+	if (pagesize == 0)
+		pagesize = sysconf(_SC_PAGESIZE);
+	return (((long)capacity*size + pagesize - 1) / pagesize) * pagesize;
+}
+
+
+/**
+ * Grows or shrinks the mapping behind a mapped array so it holds capacity
+ * elements. mremap moves the pages instead of copying them, and pages added
+ * to the mapping read as zero. Anonymous mappings ask for transparent huge
+ * pages. Returns zero, leaving array unchanged, if the mapping cannot be
+ * changed; the caller raises Mem_Failed.
+ *
+ * @param {T} array   Mapped Array_T array
+ * @param {int} capacity   Number of elements the mapping holds
+ * @return        Nonzero if array now holds capacity elements
+ */
+static int remap (T array, int capacity) {
+	long oldsize = mapsize(array->capacity, array->size);
+	long newsize = mapsize(capacity, array->size);
+	void *ary;
+
+	assert(array->mapped);
+	assert(capacity >= array->length);
+	if (newsize == oldsize)
+		ary = array->array;
+	else if (newsize == 0) {
+		munmap(array->array, oldsize);
+		ary = NULL;
+	} else {
+		if (oldsize == 0)
+			ary = mmap(NULL, newsize, PROT_READ | PROT_WRITE,
+				array->fd >= 0 ? MAP_SHARED : MAP_PRIVATE | MAP_ANONYMOUS, array->fd, 0);
+		else {
+#ifdef MREMAP_MAYMOVE
+			ary = mremap(array->array, oldsize, newsize, MREMAP_MAYMOVE);
+#else
+			ary = mmap(NULL, newsize, PROT_READ | PROT_WRITE,
+				array->fd >= 0 ? MAP_SHARED : MAP_PRIVATE | MAP_ANONYMOUS, array->fd, 0);
+			if (ary != MAP_FAILED && array->fd < 0)
+				memcpy(ary, array->array, (long)array->length*array->size);
+			if (ary != MAP_FAILED)
+				munmap(array->array, oldsize);
+#endif
+		}
+		if (ary == MAP_FAILED)
+			return 0;
+#ifdef MADV_HUGEPAGE
+		if (array->fd < 0)
+			madvise(ary, newsize, MADV_HUGEPAGE);
+#endif
+	}
+	array->array = ary;
+	array->capacity = capacity;
+
+	return 1;
+}
+
+
+/**
+ * Moves the elements of array to a new cache-line-aligned block that holds
+ * capacity elements. RESIZE would not preserve the alignment.
+ *
+ * @param {T} array   Array_T array
+ * @param {int} capacity   Number of elements the new block holds
+ */
+static void relocate (T array, int capacity) {
+	char *ary;
+
+	assert(capacity >= array->length && capacity > 0);
+	ary = ALLOC_ALIGNED((long)capacity*array->size, ALIGN);
+	if (array->array) {
+		memcpy(ary, array->array, (long)array->length*array->size);
+		FREE(array->array);
+	}
+	array->array = ary;
+	array->capacity = capacity;
+}
+
+
+/**
+ * Element kernels for the integer widths handled by Array_sum, Array_min and
+ * Array_max. Each loop walks a contiguous buffer with a compile-time element
+ * type, which lets the compiler turn it into vector code.
+ */
+#define KERNELS(type, w) \
+static long sum##w (const type *a, int n) { \
+	long s = 0; \
+	int i; \
+	for (i = 0; i < n; i++) \
+		s += a[i]; \
+	return s; \
+} \
+static long min##w (const type *a, int n) { \
+	type m = a[0]; \
+	int i; \
+	for (i = 1; i < n; i++) \
+		m = a[i] < m ? a[i] : m; \
+	return m; \
+} \
+static long max##w (const type *a, int n) { \
+	type m = a[0]; \
+	int i; \
+	for (i = 1; i < n; i++) \
+		m = a[i] > m ? a[i] : m; \
+	return m; \
+}
+
+KERNELS(int8_t, 8)
+KERNELS(int16_t, 16)
+KERNELS(int32_t, 32)
+KERNELS(int64_t, 64)
+
+#undef KERNELS
+
 
 ///////////////
 // functions //
 ///////////////
 
+/**
+ * Returns the number of elements array can hold before Array_resize has to
+ * move its elements to a larger block
+ *
+ * @param  {T} array   Array_T array
+ * @return       Capacity of array
+ */
+int Array_capacity (T array) {
+	assert(array);
+	return array->capacity;
+}
+
+
 /**
  * Creates a new Array_T of length elements and copies the first length elements
  * that array holds. If length exceeds the number of elements in array, the
@@ -63,14 +222,65 @@ T Array_copy (T array, int length) {
 
 	copy = Array_new(length, array->size);
 	if (copy->length >= array->length && array->length > 0)
-		memcpy(copy->array, array->array, array->length*array->size);
+		memcpy(copy->array, array->array, (long)array->length*array->size);
 	else if (array->length > copy->length && copy->length > 0)
-		memcpy(copy->array, array->array, copy->length * array->size);
+		memcpy(copy->array, array->array, (long)copy->length * array->size);
 
 	return copy;
 }
 
 
+/**
+ * Copies n elements of src, starting at element j, into dst starting at element i.
+ * Both arrays must hold elements of the same size, and the ranges may overlap
+ * when dst and src are the same array.
+ * 
+ * @param {T} dst   Destination Array_T array
+ * @param {int} i   Index of the first element to overwrite in dst
+ * @param {T} src   Source Array_T array
+ * @param {int} j   Index of the first element to copy from src
+ * @param {int} n   Number of elements to copy
+ */
+void Array_copyrange (T dst, int i, T src, int j, int n) {
+	assert(dst && src);
+	assert(dst->size == src->size);
+	assert(n >= 0);
+	assert(i >= 0 && i + n <= dst->length);
+	assert(j >= 0 && j + n <= src->length);
+	if (n > 0)
+		memmove(dst->array + (long)i*dst->size, src->array + (long)j*src->size,
+			(long)n*src->size);
+}
+
+
+/**
+ * Sets every element of array to the element pointed to by elem. The first
+ * element is copied from elem and the filled prefix is then doubled with
+ * memcpy, so the whole buffer is written in large blocks.
+ * 
+ * @param {T} array   Array_T array
+ * @param {void *} elem   Pointer to element to store in every position of array
+ */
+void Array_fill (T array, void *elem) {
+	long n, total;
+
+	assert(array);
+	assert(elem);
+	total = (long)array->length*array->size;
+	if (total == 0)
+		return;
+
+	if (array->size == 1) {
+		memset(array->array, *(unsigned char *)elem, total);
+		return;
+	}
+
+	memcpy(array->array, elem, array->size);
+	for (n = array->size; n < total; n *= 2)
+		memcpy(array->array + n, array->array, n < total - n ? n : total - n);
+}
+
+
 /**
  * Deallocates and clears *array
  * 
@@ -78,7 +288,13 @@ T Array_copy (T array, int length) {
  */
 void Array_free (T *array) {
 	assert(array && *array);
-	FREE((*array)->array);
+	if ((*array)->mapped) {
+		if ((*array)->array)
+			munmap((*array)->array, mapsize((*array)->capacity, (*array)->size));
+		if ((*array)->fd >= 0)
+			close((*array)->fd);
+	} else
+		FREE((*array)->array);
 	FREE(*array);
 }
 
@@ -92,7 +308,7 @@ void Array_free (T *array) {
 void *Array_get (T array, int i) {
 	assert(array);
 	assert(i >= 0 && i < array->length);
-	return array->array + i*array->size;
+	return array->array + (long)i*array->size;
 }
 
 
@@ -108,6 +324,67 @@ int Array_length (T array) {
 }
 
 
+/**
+ * Calls apply once with a pointer to the first element of array and its length,
+ * so a typed kernel can process the whole contiguous buffer in one loop. Clients
+ * can pass an application-specific pointer, cl, and this pointer is passed along
+ * to apply as its third argument. apply is not called for an empty array.
+ *
+ * @param {T} array   Array_T array
+ * @param {function} apply   Function that takes a pointer to the elements, the
+ *                           number of elements and an application-specific pointer
+ * @param {void *} cl   Application-specific pointer to pass to apply
+ */
+void Array_map (T array, void apply(void *elems, int n, void *cl), void *cl) {
+	assert(array);
+	assert(apply);
+	if (array->length > 0)
+		apply(array->array, array->length, cl);
+}
+
+
+/**
+ * Returns the largest element of array, whose elements must be signed integers
+ * of 1, 2, 4 or 8 bytes
+ *
+ * @param  {T} array   Non-empty Array_T array
+ * @return       Largest element of array
+ */
+long Array_max (T array) {
+	assert(array);
+	assert(array->length > 0);
+	switch (array->size) {
+	case 1: return max8((int8_t *)array->array, array->length);
+	case 2: return max16((int16_t *)array->array, array->length);
+	case 4: return max32((int32_t *)array->array, array->length);
+	case 8: return max64((int64_t *)array->array, array->length);
+	}
+	assert(0);
+	return 0;
+}
+
+
+/**
+ * Returns the smallest element of array, whose elements must be signed integers
+ * of 1, 2, 4 or 8 bytes
+ *
+ * @param  {T} array   Non-empty Array_T array
+ * @return       Smallest element of array
+ */
+long Array_min (T array) {
+	assert(array);
+	assert(array->length > 0);
+	switch (array->size) {
+	case 1: return min8((int8_t *)array->array, array->length);
+	case 2: return min16((int16_t *)array->array, array->length);
+	case 4: return min32((int32_t *)array->array, array->length);
+	case 8: return min64((int64_t *)array->array, array->length);
+	}
+	assert(0);
+	return 0;
+}
+
+
 /**
  * Allocates, initializes, and returns a new array of length elements with bounds
  * zero through length-1, unless length is zero, in which case the array has no
@@ -122,15 +399,90 @@ T Array_new (int length, int size) {
 	T array;
 
 	NEW(array);
-	if (length > 0)
-		ArrayRep_init(array, length, size, CALLOC(length, size));
-	else
+	if (length > 0) {
+		void *ary = ALLOC_ALIGNED((long)length*size, ALIGN);
+		memset(ary, '\0', (long)length*size);
+		ArrayRep_init(array, length, size, ary);
+	} else
 		ArrayRep_init(array, length, size, NULL);
 
 	return array;
 }
 
 
+/**
+ * Like Array_new, but the elements live in an anonymous memory mapping that
+ * asks for transparent huge pages. Array_resize grows the mapping with mremap,
+ * so growing a huge array does not copy its elements.
+ *
+ * @param  {int} length   Max number of elements expected in array
+ * @param  {int} size   Size in bytes of each element to be stored in array
+ * @return        Mapped array of length elements of size bytes each
+ */
+T Array_newmap (int length, int size) {
+	T array;
+
+	assert(length >= 0);
+	NEW(array);
+	ArrayRep_init(array, 0, size, NULL);
+	array->mapped = 1;
+	if (length > 0 && !remap(array, length)) {
+		FREE(array);
+		RAISE(Mem_Failed);
+	}
+	array->length = length;
+
+	return array;
+}
+
+
+/**
+ * Maps the file named path as an array of elements of size bytes, creating
+ * an empty file if none exists. The length of the array is the size of the
+ * file divided by size; elements are read in by the pager only as they are
+ * touched. Stores into the array change the file, and Array_resize changes
+ * its size, so the array can be reopened later by calling Array_open again.
+ * It is a checked runtime error to pass a null path. Raises Array_Failed if
+ * the file cannot be opened.
+ *
+ * @param  {const char *} path   Name of the file that holds the elements
+ * @param  {int} size   Size in bytes of each element stored in the file
+ * @return        Array mapped onto the file
+ */
+T Array_open (const char *path, int size) {
+	T array;
+	struct stat st;
+	int fd;
+
+	assert(path);
+	assert(size > 0);
+	// the descriptor is allocated first, so a failure to allocate it leaves
+	// no file open
+	NEW(array);
+	if ((fd = open(path, O_RDWR | O_CREAT, 0666)) < 0) {
+		FREE(array);
+		RAISE(Array_Failed);
+	}
+	if (fstat(fd, &st) < 0 || st.st_size / size > INT_MAX) {
+		close(fd);
+		FREE(array);
+		RAISE(Array_Failed);
+	}
+
+	ArrayRep_init(array, 0, size, NULL);
+	array->mapped = 1;
+	array->fd = fd;
+	if (st.st_size / size > 0 && !remap(array, st.st_size / size)) {
+		close(fd);
+		FREE(array);
+		RAISE(Mem_Failed);
+	}
+	array->length = st.st_size / size;
+
+	return array;
+}
+
+
 /**
  * Overwrites the value of element i with the new element pointed to by elem
  * 
@@ -143,34 +495,107 @@ void *Array_put (T array, int i, void *elem) {
 	assert(array);
 	assert(i >= 0 && i < array->length);
 	assert(elem);
-	memcpy(array->array + i*array->size, elem, array->size);
+	memcpy(array->array + (long)i*array->size, elem, array->size);
 
 	return elem;
 }
 
 
+/**
+ * Ensures array can hold capacity elements without moving them again. The
+ * length of array is unchanged. Calling Array_reserve invalidates any values
+ * returned by previous calls to Array_get
+ *
+ * @param {T} array   Array_T array
+ * @param {int} capacity   Minimum number of elements array must be able to hold
+ */
+void Array_reserve (T array, int capacity) {
+	assert(array);
+	assert(capacity >= 0);
+	if (capacity > array->capacity && array->mapped) {
+		if (!remap(array, capacity))
+			RAISE(Mem_Failed);
+	} else if (capacity > array->capacity)
+		relocate(array, capacity);
+}
+
+
 /**
  * Changes the size of array so that it hold length elements, expanding or
  * contracting it as necessary. If length exceeds the current length of the
- * array, the new elements are initialized to zero. Calling Array_resize
- * invalidates any values returned by previous calls to Array_get
+ * array, the new elements are initialized to zero. Contracting keeps the
+ * storage for reuse, and expanding past the capacity at least doubles it, so
+ * growing an array one element at a time costs amortized constant time per
+ * element. Calling Array_resize invalidates any values returned by previous
+ * calls to Array_get
  * 
  * @param {T} array   Array_T array
  * @param {int} length   New length of array 
  */
 void Array_resize (T array, int length) {
+	int capacity;
+
 	assert(array);
 	assert(length >= 0);
-	if (length == 0)
-		FREE(array->array);
-	else if (array->length == 0)
-		array->array = ALLOC(length * array->size);
-	else
-		RESIZE(array->array, length * array->size);
+	// a mapped file always holds exactly length elements; it is resized
+	// first so a failure leaves array unchanged
+	if (array->fd >= 0 && ftruncate(array->fd, (off_t)length*array->size) < 0)
+		RAISE(Array_Failed);
+
+	capacity = array->capacity;
+	if (length > capacity) {
+		int n = capacity < INT_MAX/2 ? 2*capacity : INT_MAX;
+		if (!array->mapped)
+			relocate(array, n > length ? n : length);
+		else if (!remap(array, n > length ? n : length)) {
+			if (array->fd >= 0)
+				ftruncate(array->fd, (off_t)array->length*array->size);
+			RAISE(Mem_Failed);
+		}
+	}
+
+	if (length > array->length) {
+		// pages mapped past the old mapping already read as zero, but the
+		// last page of the old mapping may still hold elements that were cut
+		// off by an earlier Array_resize or Array_shrink_to_fit
+		long n = length;
+		if (array->mapped && length > capacity) {
+			n = (mapsize(capacity, array->size) + array->size - 1) / array->size;
+			if (n > length)
+				n = length;
+		}
+		if (n > array->length)
+			memset(array->array + (long)array->length*array->size, '\0',
+				(n - array->length)*array->size);
+	}
 
 	array->length = length;
 }
 
+
+/**
+ * Releases the storage beyond the length of array, so its capacity equals its
+ * length. Calling Array_shrink_to_fit invalidates any values returned by previous
+ * calls to Array_get
+ *
+ * @param {T} array   Array_T array
+ */
+void Array_shrink_to_fit (T array) {
+	assert(array);
+	if (array->capacity == array->length)
+		return;
+
+	if (array->mapped) {
+		if (!remap(array, array->length))
+			RAISE(Mem_Failed);
+	} else if (array->length == 0) {
+		FREE(array->array);
+		array->capacity = 0;
+	} else
+		relocate(array, array->length);
+}
+
+
 /**
  * Returns the size of each element that can be stored in array
  * 
@@ -183,9 +608,30 @@ int Array_size (T array) {
 }
 
 
+/**
+ * Returns the sum of the elements of array, whose elements must be signed integers
+ * of 1, 2, 4 or 8 bytes. The sum of an empty array is zero.
+ *
+ * @param  {T} array   Array_T array
+ * @return       Sum of the elements of array
+ */
+long Array_sum (T array) {
+	assert(array);
+	switch (array->size) {
+	case 1: return sum8((int8_t *)array->array, array->length);
+	case 2: return sum16((int16_t *)array->array, array->length);
+	case 4: return sum32((int32_t *)array->array, array->length);
+	case 8: return sum64((int64_t *)array->array, array->length);
+	}
+	assert(0);
+	return 0;
+}
+
+
 /**
  * Initializes the fields in the Array_T structure pointed to by array to the
- * values of the arguments length, size, and ary.
+ * values of the arguments length, size, and ary. The capacity of the array is
+ * its length, and ary must come from the Mem interface.
  * 
  * @param {T} array   Pointer to Array_T structure
  * @param {int} length   Length of elements in array
@@ -194,10 +640,13 @@ int Array_size (T array) {
  */
 void ArrayRep_init (T array, int length, int size, void *ary) {
 	assert(array);
-	assert(ary && length>0 || lenght==0 && ary==NULL);
+	assert((ary && length > 0) || (length == 0 && ary == NULL));
 	assert(size > 0);
 	array->length = length;
+	array->capacity = length;
 	array->size = size;
+	array->mapped = 0;
+	array->fd = -1;
 
 	if (length > 0)
 		array->array = ary;
@@ -1,14 +1,24 @@
 #ifndef ARRAY_INCLUDED
 #define ARRAY_INCLUDED
 
+#include "except.h"
+
 #define T Array_T
 typedef struct T *T;
 
+/////////////////////////
+// exported exceptions //
+/////////////////////////
+
+extern const Except_T Array_Failed;
+
 ////////////////////////
 // exported functions //
 ////////////////////////
 
 extern T 	Array_new (int length, int size);
+extern T 	Array_newmap (int length, int size);
+extern T 	Array_open (const char *path, int size);
 extern void Array_free (T *array);
 
 extern int Array_length (T array);
@@ -18,8 +28,19 @@ extern void *Array_get (T array, int i);
 extern void *Array_put (T arrat, int i, void *elem);
 
 extern void Array_resize (T array, int length);
+extern void Array_reserve (T array, int capacity);
+extern void Array_shrink_to_fit (T array);
+extern int 	Array_capacity (T array);
 extern T 	Array_copy (T array, int length);
 
+extern void Array_fill (T array, void *elem);
+extern void Array_copyrange (T dst, int i, T src, int j, int n);
+extern void Array_map (T array, void apply(void *elems, int n, void *cl), void *cl);
+
+extern long Array_sum (T array);
+extern long Array_min (T array);
+extern long Array_max (T array);
+
 
 #undef T
 #endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+/**
+ * ArrayOf generates typed accessors for dynamic arrays whose element type is known
+ * at compile time. Array_get returns a void pointer computed with a runtime
+ * multiply by array->size, which keeps the compiler from vectorizing tight loops
+ * over the elements. ARRAYOF(name, type) defines inline functions that index the
+ * ArrayRep storage as an array of type, so the element size is a constant.
+ *
+ * The generated functions take and return ordinary Array_T values, and arrays they
+ * create are ordinary dynamic arrays; Array_resize, Array_copy, Array_free and the
+ * rest of the Array interface work on them unchanged. Like ArrayRep, importing
+ * ArrayOf identifies the clients that depend on the representation.
+ *
+ * 		ARRAYOF(Array_short, short)
+ *
+ * defines Array_short_new, Array_short_get, Array_short_put, Array_short_at and
+ * Array_short_data. _get and _put check their arguments like Array_get and
+ * Array_put; _at and _data are the unchecked fast path: _at returns a pointer to
+ * element i without checking i, and _data returns the element buffer itself,
+ * which stays valid until the next call that resizes the array.
+ */
+
+#ifndef ARRAYOF_INCLUDED
+#define ARRAYOF_INCLUDED
+
+#include "assert.h"
+#include "array.h"
+#include "arrayrep.h"
+
+/////////////////////
+// exported macros //
+/////////////////////
+
+#define ARRAYOF(name, type) \
+static inline Array_T name##_new (int length) { \
+	return Array_new(length, sizeof (type)); \
+} \
+static inline type name##_get (Array_T array, int i) { \
+	assert(array && array->size == sizeof (type)); \
+	assert(i >= 0 && i < array->length); \
+	return ((type *)array->array)[i]; \
+} \
+static inline type name##_put (Array_T array, int i, type x) { \
+	assert(array && array->size == sizeof (type)); \
+	assert(i >= 0 && i < array->length); \
+	return ((type *)array->array)[i] = x; \
+} \
+static inline type *name##_at (Array_T array, int i) { \
+	return (type *)array->array + i; \
+} \
+static inline type *name##_data (Array_T array) { \
+	assert(array && array->size == sizeof (type)); \
+	return (type *)array->array; \
+}
+
+
+/////////////////////////////
+// exported instantiations //
+/////////////////////////////
+
+ARRAYOF(Array_int, int)
+ARRAYOF(Array_long, long)
+ARRAYOF(Array_double, double)
+
+
+#endif
@@ -5,7 +5,10 @@
 
 struct T {
 	int length;
+	int capacity; // elements array can hold; length <= capacity
 	int size;
+	int mapped; // nonzero if array is a memory mapping instead of a Mem block
+	int fd; // file behind the mapping, or -1
 	char *array;
 };
 
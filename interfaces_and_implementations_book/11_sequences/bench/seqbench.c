@@ -0,0 +1,178 @@
+/**
+ * seqbench measures the throughput of Seq_T used as a deque. It runs two mixes,
+ * each on a sequence that is first filled with n values:
+ *
+ * 		queue		Seq_addhi followed by Seq_remlo, so values flow through the
+ * 					sequence and its head walks around the embedded array
+ * 		reverse		Seq_addlo followed by Seq_remhi
+ *
+ * and reports millions of operations per second. The same mixes are run on
+ * a copy of the previous implementation, which wrapped every index with % and
+ * grew by Array_resize followed by sliding the tail, so one run compares
+ * throughput before and after.
+ *
+ * 		seqbench [n [rounds]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "assert.h"
+#include "seq.h"
+#include "mem.h"
+
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+
+///////////
+// types //
+///////////
+
+/**
+ * Deque indexed with % like the previous Seq_T implementation
+ */
+struct modseq {
+	void **array;
+	int size;
+	int length;
+	int head;
+};
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+static struct modseq *mod_new (int hint) {
+	struct modseq *seq;
+
+	NEW(seq);
+	seq->size = hint > 0 ? hint : 16;
+	seq->array = ALLOC(seq->size * sizeof(void *));
+	seq->length = seq->head = 0;
+	return seq;
+}
+
+
+static void mod_expand (struct modseq *seq) {
+	int n = seq->size;
+
+	RESIZE(seq->array, 2*n * sizeof(void *));
+	seq->size = 2*n;
+	if (seq->head > 0) { // slide tail down
+		void **old = &seq->array[seq->head];
+		memcpy(old + n, old, (n - seq->head) * sizeof(void *));
+		seq->head += n;
+	}
+}
+
+
+static NOINLINE void *mod_addhi (struct modseq *seq, void *x) {
+	if (seq->length == seq->size)
+		mod_expand(seq);
+	return seq->array[(seq->head + seq->length++) % seq->size] = x;
+}
+
+
+static NOINLINE void *mod_addlo (struct modseq *seq, void *x) {
+	if (seq->length == seq->size)
+		mod_expand(seq);
+	if (--seq->head < 0)
+		seq->head = seq->size - 1;
+	seq->length++;
+	return seq->array[seq->head % seq->size] = x;
+}
+
+
+static NOINLINE void *mod_remhi (struct modseq *seq) {
+	--seq->length;
+	return seq->array[(seq->head + seq->length) % seq->size];
+}
+
+
+static NOINLINE void *mod_remlo (struct modseq *seq) {
+	void *x = seq->array[seq->head % seq->size];
+
+	seq->head = (seq->head + 1) % seq->size;
+	--seq->length;
+	return x;
+}
+
+
+static void mod_free (struct modseq **seq) {
+	FREE((*seq)->array);
+	FREE(*seq);
+}
+
+
+/**
+ * Returns the processor time in seconds since start
+ */
+static double elapsed (clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+/**
+ * Runs one mix: fills seq with n values with add, then performs rounds*n pairs
+ * of add and rem, and prints the throughput. The empty sequence starts with the
+ * default capacity, so filling it also exercises expansion.
+ */
+#define MIX(label, seq, add, rem, n, rounds) do { \
+	long i, sum = 0; \
+	clock_t start = clock(); \
+	for (i = 0; i < (n); i++) \
+		add(seq, (void *)(i + 1)); \
+	for (i = 0; i < (long)(rounds)*(n); i++) { \
+		add(seq, (void *)i); \
+		sum += (long)rem(seq); \
+	} \
+	{ \
+		double t = elapsed(start); \
+		printf("%-8s %-7s %8.1f Mops/s  (checksum %ld)\n", label, #add, \
+			((n) + 2.0*(rounds)*(n)) / t / 1e6, sum); \
+	} \
+} while (0)
+
+
+//////////
+// main //
+//////////
+
+int main (int argc, char *argv[]) {
+	int n = 100000, rounds = 100;
+
+	if (argc >= 2)
+		n = atoi(argv[1]);
+	if (argc >= 3)
+		rounds = atoi(argv[2]);
+	assert(n > 0 && rounds > 0);
+
+	{
+		struct modseq *seq = mod_new(0);
+		MIX("queue", seq, mod_addhi, mod_remlo, n, rounds);
+		mod_free(&seq);
+	}
+	{
+		Seq_T seq = Seq_new(0);
+		MIX("queue", seq, Seq_addhi, Seq_remlo, n, rounds);
+		Seq_free(&seq);
+	}
+	{
+		struct modseq *seq = mod_new(0);
+		MIX("reverse", seq, mod_addlo, mod_remhi, n, rounds);
+		mod_free(&seq);
+	}
+	{
+		Seq_T seq = Seq_new(0);
+		MIX("reverse", seq, Seq_addlo, Seq_remhi, n, rounds);
+		Seq_free(&seq);
+	}
+
+	return EXIT_SUCCESS;
+}
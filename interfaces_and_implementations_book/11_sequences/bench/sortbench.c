@@ -0,0 +1,114 @@
+/**
+ * sortbench compares the native sorts with the usual way of sorting the values
+ * of a list or a sequence, which copies them into an array and calls qsort:
+ *
+ * 		list	List_toArray + qsort		List_sort
+ * 		seq		Seq_get loop + qsort		Seq_sort
+ *
+ * The values are n random integers, and each sort is checked.
+ *
+ * 		sortbench [n]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "assert.h"
+#include "list.h"
+#include "seq.h"
+#include "mem.h"
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the wall clock time in seconds
+ */
+static double now (void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Compares two values, which are integers cast to pointers
+ */
+static int cmp (const void *x, const void *y) {
+	return (long)x < (long)y ? -1 : (long)x > (long)y;
+}
+
+
+/**
+ * Compares two array elements for qsort
+ */
+static int qcmp (const void *x, const void *y) {
+	return cmp(*(void **)x, *(void **)y);
+}
+
+
+//////////
+// main //
+//////////
+
+int main (int argc, char *argv[]) {
+	int i, n = 1000000;
+	double t;
+
+	if (argc >= 2)
+		n = atoi(argv[1]);
+	assert(n > 0);
+	srand(1);
+
+	{
+		List_T list = NULL, p;
+		void **array;
+
+		for (i = 0; i < n; i++)
+			list = List_push(list, (void *)(long)rand());
+
+		t = now();
+		array = List_toArray(list, NULL);
+		qsort(array, n, sizeof(*array), qcmp);
+		printf("list  toArray+qsort %8.1f ms\n", (now() - t) * 1e3);
+		FREE(array);
+
+		t = now();
+		list = List_sort(list, cmp);
+		printf("list  List_sort     %8.1f ms\n", (now() - t) * 1e3);
+		for (p = list; p->rest; p = p->rest)
+			assert(cmp(p->first, p->rest->first) <= 0);
+		List_free(&list);
+	}
+
+	{
+		Seq_T seq = Seq_new(n);
+		void **array;
+
+		for (i = 0; i < n; i++) // leave the values wrapped around the array
+			if (i % 2)
+				Seq_addhi(seq, (void *)(long)rand());
+			else
+				Seq_addlo(seq, (void *)(long)rand());
+
+		t = now();
+		array = ALLOC(n * sizeof(*array));
+		for (i = 0; i < n; i++)
+			array[i] = Seq_get(seq, i);
+		qsort(array, n, sizeof(*array), qcmp);
+		printf("seq   get+qsort     %8.1f ms\n", (now() - t) * 1e3);
+		FREE(array);
+
+		t = now();
+		Seq_sort(seq, cmp);
+		printf("seq   Seq_sort      %8.1f ms\n", (now() - t) * 1e3);
+		for (i = 1; i < n; i++)
+			assert(cmp(Seq_get(seq, i - 1), Seq_get(seq, i)) <= 0);
+		Seq_free(&seq);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,193 @@
+/**
+ * spscbench measures a work queue between two threads. A producer thread sends
+ * n messages to a consumer thread through
+ *
+ * 		seq		a Seq_T guarded by a mutex, with Seq_addhi and Seq_remlo
+ * 		spsc	an Spsc_T, with Spsc_addhi and Spsc_remlo
+ *
+ * and the throughput is reported in messages per second. Then the two threads
+ * bounce one message back and forth through a pair of Spsc_T queues n times,
+ * and the latency of one hop is reported in nanoseconds. A side that finds the
+ * queue full or empty yields the processor, so the benchmark also makes
+ * progress on a single core.
+ *
+ * 		spscbench [n]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "assert.h"
+#include "seq.h"
+#include "spsc.h"
+
+#define QUEUESIZE 1024
+
+
+///////////
+// types //
+///////////
+
+struct args {
+	long n;
+	Seq_T seq;
+	pthread_mutex_t *mutex;
+	Spsc_T q, back;
+	long sum;
+};
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the wall clock time in seconds
+ */
+static double now (void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void *seq_consumer (void *cl) {
+	struct args *p = cl;
+	long i;
+
+	for (i = 0; i < p->n; ) {
+		void *x = NULL;
+		pthread_mutex_lock(p->mutex);
+		if (Seq_length(p->seq) > 0)
+			x = Seq_remlo(p->seq);
+		pthread_mutex_unlock(p->mutex);
+		if (x) {
+			p->sum += (long)x;
+			i++;
+		} else
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+
+static void *spsc_consumer (void *cl) {
+	struct args *p = cl;
+	long i;
+
+	for (i = 0; i < p->n; ) {
+		void *x;
+		if (Spsc_remlo(p->q, &x)) {
+			p->sum += (long)x;
+			i++;
+		} else
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+
+static void *spsc_echo (void *cl) {
+	struct args *p = cl;
+	long i;
+
+	for (i = 0; i < p->n; i++) {
+		void *x;
+		while (!Spsc_remlo(p->q, &x))
+			sched_yield();
+		while (!Spsc_addhi(p->back, x))
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+
+//////////
+// main //
+//////////
+
+int main (int argc, char *argv[]) {
+	long i, n = 10000000;
+	double t;
+	pthread_t consumer;
+	struct args args;
+
+	if (argc >= 2)
+		n = atol(argv[1]);
+	assert(n > 0);
+	args.n = n;
+
+	{
+		pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+		args.seq = Seq_new(QUEUESIZE);
+		args.mutex = &mutex;
+		args.sum = 0;
+		t = now();
+		pthread_create(&consumer, NULL, seq_consumer, &args);
+		for (i = 1; i <= n; ) {
+			int sent = 0;
+			pthread_mutex_lock(&mutex);
+			if (Seq_length(args.seq) < QUEUESIZE) {
+				Seq_addhi(args.seq, (void *)i);
+				sent = 1;
+			}
+			pthread_mutex_unlock(&mutex);
+			if (sent)
+				i++;
+			else
+				sched_yield();
+		}
+		pthread_join(consumer, NULL);
+		t = now() - t;
+		assert(args.sum == n*(n + 1)/2);
+		printf("seq+mutex %8.2f Mmsgs/s\n", n / t / 1e6);
+		Seq_free(&args.seq);
+	}
+
+	{
+		args.q = Spsc_new(QUEUESIZE);
+		args.sum = 0;
+		t = now();
+		pthread_create(&consumer, NULL, spsc_consumer, &args);
+		for (i = 1; i <= n; )
+			if (Spsc_addhi(args.q, (void *)i))
+				i++;
+			else
+				sched_yield();
+		pthread_join(consumer, NULL);
+		t = now() - t;
+		assert(args.sum == n*(n + 1)/2);
+		printf("spsc      %8.2f Mmsgs/s\n", n / t / 1e6);
+		Spsc_free(&args.q);
+	}
+
+	{
+		long trips = n / 10 > 0 ? n / 10 : 1;
+		args.n = trips;
+		args.q = Spsc_new(QUEUESIZE);
+		args.back = Spsc_new(QUEUESIZE);
+		t = now();
+		pthread_create(&consumer, NULL, spsc_echo, &args);
+		for (i = 0; i < trips; i++) {
+			void *x;
+			while (!Spsc_addhi(args.q, (void *)(i + 1)))
+				sched_yield();
+			while (!Spsc_remlo(args.back, &x))
+				sched_yield();
+			assert((long)x == i + 1);
+		}
+		pthread_join(consumer, NULL);
+		t = now() - t;
+		printf("spsc      %8.1f ns/hop\n", t / trips / 2 * 1e9);
+		Spsc_free(&args.q);
+		Spsc_free(&args.back);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -16,6 +16,9 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "assert.h"
 #include "seq.h"
 #include "array.h"
@@ -24,11 +27,30 @@
 
 #define T Seq_T
 
+// Capacities are powers of two, so an index wraps around the embedded array
+// with a mask instead of a division
+#define MINCAPACITY 16
+#define slot(seq, i) (((void **)(seq)->array.array)[((seq)->head + (i)) & ((seq)->array.length - 1)])
+
+// Seq_sort hands halves longer than CUTOFF values to another thread
+#define CUTOFF 10000
+
 struct T {
 	struct Array_T array;
 	int length;
 	int head;
-}
+	int reserve; // capacity the sequence never shrinks below
+};
+
+/**
+ * Arguments of msort, which is also the start routine of Seq_sort's threads
+ */
+struct sort {
+	void **a, **tmp;
+	int n;
+	int depth; // number of levels that may still start a thread
+	int (*cmp)(const void *x, const void *y);
+};
 
 
 //////////////////////
@@ -36,22 +58,123 @@ struct T {
 //////////////////////
 
 /**
- * Encapsulates a call to Array_resize that doubles the size of a sequence's embedded
- * array
+ * Returns the smallest power of two that is at least n and at least MINCAPACITY.
+ * It is a checked runtime error for n to exceed the largest power of two an int
+ * holds.
+ *
+ * @param  {int} n   Number of values
+ * @return     Capacity that holds n values
+ */
+static int roundup (int n) {
+	int capacity = MINCAPACITY;
+
+	assert(n <= INT_MAX/2 + 1);
+	while (capacity < n)
+		capacity <<= 1;
+
+	return capacity;
+}
+
+
+/**
+ * Moves the values of seq to a new array of capacity slots, unwrapping them so
+ * the lowest value lands in slot zero. Values are copied with at most two calls
+ * to memcpy, one for each side of the wraparound.
+ *
+ * @param {T} seq   Seq_T sequence
+ * @param {int} capacity   Power-of-two number of slots of the new array
+ */
+static void relocate (T seq, int capacity) {
+	void **ary;
+	int n;
+
+	assert(capacity >= seq->length && (capacity & (capacity - 1)) == 0);
+	ary = ALLOC(capacity * sizeof(void *));
+	n = seq->array.length - seq->head;
+	if (n > seq->length)
+		n = seq->length;
+	memcpy(ary, (void **)seq->array.array + seq->head, n * sizeof(void *));
+	memcpy(ary + n, seq->array.array, (seq->length - n) * sizeof(void *));
+	FREE(seq->array.array);
+	ArrayRep_init(&seq->array, capacity, sizeof(void *), ary);
+	seq->head = 0;
+}
+
+
+/**
+ * Doubles the size of a sequence's embedded array
  * 
  * @param {T} seq   Seq_T sequence to expand
  */
 static void expand (T seq) {
+	relocate(seq, 2*seq->array.length);
+}
+
+
+/**
+ * Halves the size of a sequence's embedded array once three quarters of it are
+ * idle, so a sequence that drains after a burst gives the space back. Sequences
+ * never shrink below the capacity they were created or reserved with.
+ *
+ * @param {T} seq   Seq_T sequence to shrink
+ */
+static void shrink (T seq) {
 	int n = seq->array.length;
 
-	Array_resize(&seq->array, 2*n);
-	if (seq->head > 0) // slide tail down
-		{
-			void **old = &((void **)seq->array.array)[seq->head];
-			memcpy(old + n, old, (n - seq->head) * sizeof(void *));
-			seq->head += n;
-		}
+	if (seq->length <= n/4 && n/2 >= seq->reserve)
+		relocate(seq, n/2);
+}
 
+
+/**
+ * Stable merge sort of p->a[0..n-1], using p->tmp[0..n-1] as scratch space. Below
+ * p->depth levels of recursion, the left half is sorted by a new thread while
+ * this thread sorts the right half, as long as the halves are longer than CUTOFF.
+ * Short runs are sorted by insertion.
+ *
+ * @param  {void *} cl   struct sort describing the values to sort
+ * @return      NULL
+ */
+static void *msort (void *cl) {
+	struct sort *p = cl, left, right;
+	int h = p->n/2, i, j, k;
+	pthread_t t;
+	int spawned = 0;
+
+	if (p->n < 16) {
+		for (i = 1; i < p->n; i++) {
+			void *x = p->a[i];
+			for (j = i; j > 0 && p->cmp(x, p->a[j-1]) < 0; j--)
+				p->a[j] = p->a[j-1];
+			p->a[j] = x;
+		}
+		return NULL;
+	}
+
+	left = right = *p;
+	left.n = h;
+	right.a += h;
+	right.tmp += h;
+	right.n -= h;
+	left.depth = right.depth = p->depth - 1;
+	if (p->depth > 0 && h > CUTOFF)
+		spawned = pthread_create(&t, NULL, msort, &left) == 0;
+	if (!spawned)
+		msort(&left);
+	msort(&right);
+	if (spawned)
+		pthread_join(t, NULL);
+
+	// merge a[0..h-1] and a[h..n-1]; values of the left half win ties
+	memcpy(p->tmp, p->a, h * sizeof(void *));
+	for (i = 0, j = h, k = 0; i < h && j < p->n; k++)
+		if (p->cmp(p->a[j], p->tmp[i]) < 0)
+			p->a[k] = p->a[j++];
+		else
+			p->a[k] = p->tmp[i++];
+	memcpy(p->a + k, p->tmp + i, (h - i) * sizeof(void *));
+
+	return NULL;
 }
 
 
@@ -77,7 +200,36 @@ void *Seq_addhi (T seq, void *x) {
 	i = seq->length++;
 
 	// return seq[i] = x
-	return ((void **)seq->array.array)[(seq->head + 1) % seq->array.length] = x;
+	return slot(seq, i) = x;
+}
+
+
+/**
+ * Adds the n values in items[0..n-1] to the high end of seq, in order, as if by
+ * n calls to Seq_addhi. The values are copied with at most two calls to memcpy,
+ * one for each side of the wraparound, after expanding seq at most once.
+ *
+ * @param {T} seq   Seq_T sequence
+ * @param {void **} items   Values to add to seq
+ * @param {int} n   Number of values in items
+ */
+void Seq_addhiv (T seq, void **items, int n) {
+	int i, k;
+
+	assert(seq);
+	assert(n >= 0);
+	assert(items || n == 0);
+	assert(n <= INT_MAX - seq->length);
+	if (seq->length + n > seq->array.length)
+		relocate(seq, roundup(seq->length + n));
+
+	i = (seq->head + seq->length) & (seq->array.length - 1);
+	k = seq->array.length - i;
+	if (k > n)
+		k = n;
+	memcpy((void **)seq->array.array + i, items, k * sizeof(void *));
+	memcpy(seq->array.array, items + k, (n - k) * sizeof(void *));
+	seq->length += n;
 }
 
 
@@ -97,13 +249,11 @@ void *Seq_addlo (T seq, void *x) {
 	if (seq->length == seq->array.length)
 		expand(seq);
 
-	if (--seq->head < 0)
-		seq->head = seq->array.length - 1;
-
+	seq->head = (seq->head - 1) & (seq->array.length - 1);
 	seq->length++;
 
 	// return seq[i] = x
-	return ((void **)seq->array.array)[(seq->head + 1) % seq->array.length] = x;
+	return slot(seq, i) = x;
 }
 
 
@@ -131,7 +281,7 @@ void *Seq_get (T seq, int i) {
 	assert(i >= 0 && i < seq->length);
 
 	// seq[i]
-	return ((void **)seq->array.array)[(seq->head + i) % seq->array.length];
+	return slot(seq, i);
 }
 
 
@@ -148,7 +298,9 @@ int Seq_length (T seq) {
 
 
 /**
- * Creates and returns an empty sequence
+ * Creates and returns an empty sequence. The embedded array starts with the
+ * smallest power-of-two capacity that holds hint values.
+ *
  * @param  {int} hint   Estimate of max number values of sequence
  * @return      New Sequence
  */
@@ -157,10 +309,8 @@ T Seq_new (int hint) {
 
 	assert(hint >= 0);
 	NEW0(seq);
-	if (hint == 0)
-		hint = 16;
-
-	ArrayRep_init(&seq->array, hint, sizeof(void *), ALLOC(hint * sizeof(void *)));
+	seq->reserve = roundup(hint);
+	ArrayRep_init(&seq->array, seq->reserve, sizeof(void *), ALLOC(seq->reserve * sizeof(void *)));
 
 	return seq;
 }
@@ -181,9 +331,9 @@ void *Seq_put (T seq, int i, void *x) {
 	assert(i >= 0 && i < seq->length);
 
 	// prev = seq[i]
-	prev = ((void **)seq->array.array)[(seq->head + i) % seq->array.length];
+	prev = slot(seq, i);
 	// seq[i] = x
-	((void **)seq->array.array)[(seq->head + i) % seq->array.length];
+	slot(seq, i) = x;
 
 	return prev;
 }
@@ -198,13 +348,17 @@ void *Seq_put (T seq, int i, void *x) {
  */
 void *Seq_remhi (T seq) {
 	int i;
+	void *x;
 
 	assert(seq);
 	assert(seq->length > 0);
 	i = --seq->length;
 
-	// seq[i]
-	return ((void **)seq->array.array)[(seq->head + 1) % seq->array.length];
+	// x = seq[i]
+	x = slot(seq, i);
+	shrink(seq);
+
+	return x;
 }
 
 
@@ -223,15 +377,67 @@ void *Seq_remlo (T seq) {
 	assert(seq);
 	assert(seq->length > 0);
 	// x = seq[i]
-	x = ((void **)seq->array.array)[(seq->head + 1) % seq->array.length];
+	x = slot(seq, i);
 
-	seq->head = (seq->head + 1) % seq->array.length;
+	seq->head = (seq->head + 1) & (seq->array.length - 1);
 	--seq->length;
+	shrink(seq);
 
 	return x;
 }
 
 
+/**
+ * Removes up to n values from the low end of seq and stores them in out[0..],
+ * lowest first, as if by repeated calls to Seq_remlo. The values are copied
+ * with at most two calls to memcpy, one for each side of the wraparound.
+ *
+ * @param  {T} seq   Seq_T sequence
+ * @param  {void **} out   Array that receives the removed values
+ * @param  {int} n   Max number of values to remove
+ * @return     Number of values removed, which is less than n when seq holds
+ *             fewer than n values
+ */
+int Seq_remlov (T seq, void **out, int n) {
+	int k;
+
+	assert(seq);
+	assert(n >= 0);
+	assert(out || n == 0);
+	if (n > seq->length)
+		n = seq->length;
+
+	k = seq->array.length - seq->head;
+	if (k > n)
+		k = n;
+	memcpy(out, (void **)seq->array.array + seq->head, k * sizeof(void *));
+	memcpy(out + k, seq->array.array, (n - k) * sizeof(void *));
+	seq->head = (seq->head + n) & (seq->array.length - 1);
+	seq->length -= n;
+	shrink(seq);
+
+	return n;
+}
+
+
+/**
+ * Ensures seq can hold n values without expanding, and keeps it from shrinking
+ * below that capacity afterwards
+ *
+ * @param {T} seq   Seq_T sequence
+ * @param {int} n   Number of values seq must be able to hold
+ */
+void Seq_reserve (T seq, int n) {
+	assert(seq);
+	assert(n >= 0);
+	n = roundup(n);
+	if (n > seq->reserve)
+		seq->reserve = n;
+	if (n > seq->array.length)
+		relocate(seq, n);
+}
+
+
 /**
  * Creates and returns a Sequence whose values are initialized to its non-null pointer
  * arguments. The argument list is terminated by the first null pointer.
@@ -261,3 +467,34 @@ T Seq_seq (void *x, ...) {
 
 	return seq;
 }
+
+
+/**
+ * Sorts the values of seq in place. cmp compares two values and returns an integer
+ * less than, equal to, or greater than zero, like strcmp. The sort is a stable
+ * merge sort; sequences longer than CUTOFF values are sorted by as many threads
+ * as there are processors online.
+ *
+ * @param {T} seq   Seq_T sequence
+ * @param {function} cmp   Function that compares two values of seq
+ */
+void Seq_sort (T seq, int cmp(const void *x, const void *y)) {
+	struct sort args;
+	long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	assert(seq);
+	assert(cmp);
+	if (seq->length < 2)
+		return;
+	if (seq->head + seq->length > seq->array.length) // unwrap the values
+		relocate(seq, seq->array.length);
+
+	args.a = (void **)seq->array.array + seq->head;
+	args.tmp = ALLOC(seq->length * sizeof(void *));
+	args.n = seq->length;
+	args.cmp = cmp;
+	for (args.depth = 0; (1L << args.depth) < nprocs; args.depth++)
+		;
+	msort(&args);
+	FREE(args.tmp);
+}
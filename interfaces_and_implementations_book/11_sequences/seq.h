@@ -24,6 +24,12 @@ extern void *Seq_addhi (T seq, void *x);
 extern void *Seq_remlo (T seq);
 extern void *Seq_remhi (T seq);
 
+extern void Seq_addhiv (T seq, void **items, int n);
+extern int Seq_remlov (T seq, void **out, int n);
+
+extern void Seq_reserve (T seq, int n);
+extern void Seq_sort (T seq, int cmp(const void *x, const void *y));
+
 
 #undef T
 #endif
\ No newline at end of file
@@ -0,0 +1,145 @@
+/**
+ * The Spsc is a ring of power-of-two capacity indexed by two ever-increasing
+ * counters: tail, written only by the producer, and head, written only by the
+ * consumer. The producer publishes a value by storing it and then releasing
+ * tail; the consumer acquires tail before reading the value, and releases head
+ * after it, which tells the producer the slot can be reused.
+ *
+ * Each counter lives on its own cache line together with the side's cached
+ * copy of the other counter, so on the fast path the producer and the consumer
+ * never touch the same line except for the slots themselves. A side rereads the
+ * other side's counter only when its cached copy says the ring is full or empty.
+ */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "assert.h"
+#include "spsc.h"
+#include "mem.h"
+
+#define T Spsc_T
+
+#define CACHELINE 64
+
+struct T {
+	// read-only after Spsc_new
+	void **slots;
+	unsigned long mask;
+
+	// written by the consumer
+	_Alignas(CACHELINE) atomic_ulong head;
+	unsigned long tailcache;
+
+	// written by the producer
+	_Alignas(CACHELINE) atomic_ulong tail;
+	unsigned long headcache;
+};
+
+
+///////////////
+// functions //
+///////////////
+
+/**
+ * Adds x to the high end of q. Only the producer thread may call Spsc_addhi.
+ *
+ * @param  {T} q   Spsc_T sequence
+ * @param  {void *} x   Pointer to value to add to q
+ * @return     One if x was added, zero if q is full
+ */
+int Spsc_addhi (T q, void *x) {
+	unsigned long tail;
+
+	assert(q);
+	tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	if (tail - q->headcache > q->mask) {
+		q->headcache = atomic_load_explicit(&q->head, memory_order_acquire);
+		if (tail - q->headcache > q->mask)
+			return 0;
+	}
+
+	q->slots[tail & q->mask] = x;
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+
+	return 1;
+}
+
+
+/**
+ * Deallocates the sequence pointed to by q and clears the pointer. Neither
+ * thread may use q afterwards.
+ *
+ * @param {T *} q   Pointer to Spsc_T sequence
+ */
+void Spsc_free (T *q) {
+	assert(q && *q);
+	FREE((*q)->slots);
+	FREE(*q);
+}
+
+
+/**
+ * Returns the number of values in q. While the other thread runs, the result
+ * is only a snapshot.
+ *
+ * @param  {T} q   Spsc_T sequence
+ * @return     Number of values in q
+ */
+int Spsc_length (T q) {
+	assert(q);
+	return atomic_load_explicit(&q->tail, memory_order_acquire)
+		- atomic_load_explicit(&q->head, memory_order_acquire);
+}
+
+
+/**
+ * Creates and returns an empty sequence that holds up to hint values, rounded
+ * up to a power of two
+ *
+ * @param  {int} hint   Max number of values in the sequence
+ * @return     New Spsc_T sequence
+ */
+T Spsc_new (int hint) {
+	T q;
+	unsigned long capacity = 16;
+
+	assert(hint >= 0);
+	while (capacity < (unsigned long)hint)
+		capacity <<= 1;
+
+	q = ALLOC_ALIGNED(sizeof *q, CACHELINE);
+	q->slots = ALLOC_ALIGNED(capacity * sizeof(void *), CACHELINE);
+	q->mask = capacity - 1;
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+	q->tailcache = q->headcache = 0;
+
+	return q;
+}
+
+
+/**
+ * Removes the value at the low end of q and stores it in *x. Only the consumer
+ * thread may call Spsc_remlo.
+ *
+ * @param  {T} q   Spsc_T sequence
+ * @param  {void **} x   Location that receives the removed value
+ * @return     One if a value was removed, zero if q is empty
+ */
+int Spsc_remlo (T q, void **x) {
+	unsigned long head;
+
+	assert(q);
+	assert(x);
+	head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	if (head == q->tailcache) {
+		q->tailcache = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if (head == q->tailcache)
+			return 0;
+	}
+
+	*x = q->slots[head & q->mask];
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+
+	return 1;
+}
@@ -0,0 +1,33 @@
+/**
+ * An Spsc is a bounded sequence restricted to the one use that needs no locks:
+ * a single producer thread adds values at the high end and a single consumer
+ * thread removes them from the low end, like Seq_addhi and Seq_remlo on a
+ * sequence used as a work queue. Spsc_addhi fails instead of expanding when
+ * the sequence is full, and Spsc_remlo fails instead of asserting when it is
+ * empty, so either side can poll, spin or back off as it sees fit.
+ *
+ * It is an unchecked runtime error for more than one thread to call Spsc_addhi,
+ * or more than one thread to call Spsc_remlo, on the same Spsc_T.
+ */
+
+#ifndef SPSC_INCLUDED
+#define SPSC_INCLUDED
+
+#define T Spsc_T
+typedef struct T *T;
+
+////////////////////////
+// exported functions //
+////////////////////////
+
+extern T Spsc_new (int hint);
+extern void Spsc_free (T *q);
+
+extern int Spsc_length (T q);
+
+extern int Spsc_addhi (T q, void *x);
+extern int Spsc_remlo (T q, void **x);
+
+
+#undef T
+#endif
@@ -0,0 +1,73 @@
+/**
+ * ringbench times the positional Ring operations on a ring of n values. It is
+ * linked with either implementation of the Ring interface, so comparing them
+ * takes two builds from the same source:
+ *
+ * 		cc ... bench/ringbench.c ring.c ...			unrolled linked list
+ * 		cc ... bench/ringbench.c ringtree.c ...		balanced tree
+ *
+ * After building the ring with Ring_addhi, it performs ops random Ring_get,
+ * Ring_put, Ring_add, Ring_remove and Ring_rotate calls each, and reports the
+ * average time of each operation in nanoseconds.
+ *
+ * 		ringbench [n [ops]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "assert.h"
+#include "ring.h"
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the processor time in seconds since start
+ */
+static double elapsed (clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+/**
+ * Times ops executions of stmt and prints the average in nanoseconds
+ */
+#define TIME(label, ops, stmt) do { \
+	long k; \
+	clock_t start = clock(); \
+	for (k = 0; k < (ops); k++) \
+		stmt; \
+	printf("%-12s %10.1f ns\n", label, elapsed(start) / (ops) * 1e9); \
+} while (0)
+
+
+//////////
+// main //
+//////////
+
+int main (int argc, char *argv[]) {
+	long n = 1000000, ops = 10000, sum = 0;
+	Ring_T ring = Ring_new();
+
+	if (argc >= 2)
+		n = atol(argv[1]);
+	if (argc >= 3)
+		ops = atol(argv[2]);
+	assert(n > 0 && ops > 0);
+	srand(1);
+
+	TIME("Ring_addhi", n, Ring_addhi(ring, (void *)k));
+	TIME("Ring_get", ops, sum += (long)Ring_get(ring, rand() % n));
+	TIME("Ring_put", ops, Ring_put(ring, rand() % n, (void *)k));
+	TIME("Ring_add", ops, Ring_add(ring, 1 + rand() % n, (void *)k));
+	TIME("Ring_remove", ops, Ring_remove(ring, rand() % n));
+	TIME("Ring_rotate", ops, Ring_rotate(ring, rand() % n));
+	assert(Ring_length(ring) == n);
+
+	Ring_free(&ring);
+	printf("checksum %ld\n", sum);
+	return EXIT_SUCCESS;
+}
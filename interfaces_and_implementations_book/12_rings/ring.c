@@ -9,6 +9,13 @@
  * right increments the inidices by one modulo the Ring length. The price for the
  * flexibility of adding values to and removing values from arbitrary locations in a ring
  * is that accessing the ith value is not guaranteed to take a constant time.
+ *
+ * The ring is an unrolled doubly-linked list: each node holds up to NVALUES values in
+ * an array, so finding the ith value walks about i/NVALUES nodes instead of i, and the
+ * values of one node share a few cache lines. Value zero is the first value of the head
+ * node, and the values of each node follow those of its left neighbor.
+ *
+ * Deleted nodes go on a per-ring free list for reuse by later insertions.
  */
 
 #include <stdlib.h>
@@ -20,15 +27,220 @@
 
 #define T Ring_T
 
+#define NVALUES 32
+#define NBLOCK 16
+
 struct T {
 	struct node {
 		struct node *llink, *rlink;
-		void *value;
+		int n; // value[0..n-1] hold values; n > 0
+		void *value[NVALUES];
 	} *head;
 	int length;
+	struct node *free; // unused nodes, linked by rlink
+	struct block *blocks;
+	int nblock; // nodes in the next block; zero before the first
+};
+
+/**
+ * Nodes are allocated a block at a time and never returned to Mem until Ring_free,
+ * so a ring whose length stays bounded stops allocating once its free list has
+ * enough nodes. A ring's first block holds one node and each later block twice as
+ * many as the one before, up to NBLOCK, so small rings stay small.
+ */
+struct block {
+	struct block *link;
+	struct node nodes[];
 };
 
 
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the node that holds the ith value in ring and sets *k to the index of
+ * that value in the node. Walks from whichever end of the ring is closer.
+ *
+ * @param  {T} ring   Non-empty Ring_T ring
+ * @param  {int} i   Index of value in ring
+ * @param  {int *} k   Receives the index of the value in the returned node
+ * @return      Node that holds the ith value
+ */
+static struct node *locate (T ring, int i, int *k) {
+	struct node *q;
+
+	assert(i >= 0 && i < ring->length);
+	if (i <= ring->length/2) {
+		for (q = ring->head; i >= q->n; q = q->rlink)
+			i -= q->n;
+		*k = i;
+	} else {
+		int j = ring->length - i;
+		for (q = ring->head->llink; j > q->n; q = q->llink)
+			j -= q->n;
+		*k = q->n - j;
+	}
+
+	return q;
+}
+
+
+/**
+ * Allocates a block of nodes and adds them to the free list of ring
+ *
+ * @param {T} ring   Ring_T ring
+ */
+static void refill (T ring) {
+	struct block *b;
+	int i, n = ring->nblock ? ring->nblock : 1;
+
+	b = ALLOC(sizeof (*b) + n*sizeof (b->nodes[0]));
+	b->link = ring->blocks;
+	ring->blocks = b;
+	for (i = 0; i < n; i++) {
+		b->nodes[i].rlink = ring->free;
+		ring->free = &b->nodes[i];
+	}
+	ring->nblock = n < NBLOCK ? 2*n : NBLOCK;
+}
+
+
+/**
+ * Takes an empty node from the free list and inserts it to the right of q, or
+ * makes it the only node of ring if q is null
+ *
+ * @param  {T} ring   Ring_T ring
+ * @param  {struct node *} q   Node to the left of the new node, or null
+ * @return      New node
+ */
+static struct node *newnode (T ring, struct node *q) {
+	struct node *p;
+
+	if (ring->free == NULL)
+		refill(ring);
+	p = ring->free;
+	ring->free = p->rlink;
+	p->n = 0;
+	if (q) { // insert p to the right of q
+		p->llink = q;
+		p->rlink = q->rlink;
+		q->rlink->llink = p;
+		q->rlink = p;
+	} else // make p ring's only node
+		ring->head = p->llink = p->rlink = p;
+
+	return p;
+}
+
+
+/**
+ * Unlinks node q from ring and puts it on the free list
+ *
+ * @param {T} ring   Ring_T ring
+ * @param {struct node *} q   Node to delete
+ */
+static void delnode (T ring, struct node *q) {
+	if (q->rlink == q)
+		ring->head = NULL;
+	else {
+		if (q == ring->head)
+			ring->head = q->rlink;
+		q->llink->rlink = q->rlink;
+		q->rlink->llink = q->llink;
+	}
+	q->rlink = ring->free;
+	ring->free = q;
+}
+
+
+/**
+ * Moves the values of q's right neighbor into q and deletes the neighbor, if
+ * together they hold at most limit values. The head node is never merged into
+ * its left neighbor, which would move value zero.
+ *
+ * @param {T} ring   Ring_T ring
+ * @param {struct node *} q   Node to merge into
+ * @param {int} limit   Max number of values of the merged node
+ */
+static void merge (T ring, struct node *q, int limit) {
+	struct node *p = q->rlink;
+
+	if (p != q && p != ring->head && q->n + p->n <= limit) {
+		memcpy(&q->value[q->n], p->value, p->n * sizeof(void *));
+		q->n += p->n;
+		delnode(ring, p);
+	}
+}
+
+
+/**
+ * Moves the values q->value[k..] into a new node to the right of q
+ *
+ * @param  {T} ring   Ring_T ring
+ * @param  {struct node *} q   Node to split
+ * @param  {int} k   Index of the first value to move
+ * @return      New node
+ */
+static struct node *split (T ring, struct node *q, int k) {
+	struct node *p = newnode(ring, q);
+
+	p->n = q->n - k;
+	memcpy(p->value, &q->value[k], p->n * sizeof(void *));
+	q->n = k;
+
+	return p;
+}
+
+
+/**
+ * Inserts x before q->value[k], splitting q in half first if it is full
+ *
+ * @param {T} ring   Ring_T ring
+ * @param {struct node *} q   Node that receives x
+ * @param {int} k   Index of x in q, 0 <= k <= q->n
+ * @param {void *} x   Value to insert
+ */
+static void insert (T ring, struct node *q, int k, void *x) {
+	assert(k >= 0 && k <= q->n);
+	if (q->n == NVALUES) {
+		struct node *p = split(ring, q, NVALUES/2);
+		if (k > NVALUES/2) {
+			q = p;
+			k -= NVALUES/2;
+		}
+	}
+
+	memmove(&q->value[k + 1], &q->value[k], (q->n - k) * sizeof(void *));
+	q->value[k] = x;
+	q->n++;
+	ring->length++;
+}
+
+
+/**
+ * Removes and returns q->value[k]. Deletes q once it is empty, and otherwise
+ * merges it with its right neighbor when both are sparse.
+ *
+ * @param  {T} ring   Ring_T ring
+ * @param  {struct node *} q   Node that holds the value
+ * @param  {int} k   Index of the value in q
+ * @return      Removed value
+ */
+static void *delete (T ring, struct node *q, int k) {
+	void *x = q->value[k];
+
+	memmove(&q->value[k], &q->value[k + 1], (q->n - k - 1) * sizeof(void *));
+	ring->length--;
+	if (--q->n == 0)
+		delnode(ring, q);
+	else
+		merge(ring, q, 3*NVALUES/4);
+
+	return x;
+}
+
+
 ///////////////
 // functions //
 ///////////////
@@ -43,8 +255,8 @@ struct T {
  *
  * Adding a new value increments both the indices of the values to its right and
  * the length of the ring by one
- * 		
- * 		
+ *
+ *
  * @param  {T} ring   Ring_T ring
  * @param  {int} pos   Index to add x
  * @param  {void *} x   Pointer of element to add to ring's ith position
@@ -52,38 +264,22 @@ struct T {
  */
 void *Ring_add (T ring, int pos, void *x) {
 	assert(ring);
-	assert(pos >= -ring->lengt && pos <= ring->lengt+1);
+	assert(pos >= -ring->length && pos <= ring->length+1);
 
 	if (pos == 1 || pos == -ring->length)
 		return Ring_addlo(ring, x);
-	else if (pos == 0 || pos == right->length + 1)
+	else if (pos == 0 || pos == ring->length + 1)
 		return Ring_addhi(ring, x);
 	else {
-		struct node *p, *q;
-		int i = pos < 0 ? pos + ring->length : pos - 1;
-		// q <- ith node
-		{
-			int n;
-			q = ring->head;
-			if (i <= ring->length/2)
-				for (n = i; n-- > 0; )
-					q = q->rlink;
-			else
-				for (n = ring->length - i; n-- > 0; )
-					q = q->llink;
-		}
+		struct node *q;
+		int k, i = pos < 0 ? pos + ring->length : pos - 1;
 
-		NEW(p);
-		// insert p to the left of q
-		{
-			p->llink = q->llink;
-			q->llink->rlink = p;
-			p->rlink = q;
-			q->llink = p;
-		}
+		// q <- node of the ith value
+		q = locate(ring, i, &k);
+		// insert x to the left of the ith value
+		insert(ring, q, k, x);
 
-		ring->length++;
-		return p->value = x;
+		return x;
 	}
 }
 
@@ -91,60 +287,62 @@ void *Ring_add (T ring, int pos, void *x) {
 /**
  * Adds x to the high end of ring and returns x. Adding a value to the end of a
  * ring increments the length of the ring by one
- * 
+ *
  * @param  {T} ring   Ring_T ring
  * @param  {void *} x   Pointer to element to add to ring
  * @return      x
  */
 void *Ring_addhi (T ring, void *x) {
-	struct node *p, *q;
+	struct node *q;
 
 	assert(ring);
-	NEW(p);
-	if ((q = ring->head) != NULL) // insert p to the left of q
-	{
-		p->llink = q->llink;
-		q->llink->rlink = p;
-		p->rlink = q;
-		q->llink = p;
-	} else // make p ring's only value
-		ring->head = p->llink = p->rlink = p;
+	if ((q = ring->head) == NULL)
+		q = newnode(ring, NULL);
+	else if ((q = q->llink)->n == NVALUES)
+		q = newnode(ring, q);
 
+	q->value[q->n++] = x;
 	ring->length++;
-	return p->value = x;
+	return x;
 }
 
 
 /**
  * Adds x to the low end of ring and returns x. Adding a value to the begining of a
  * ring increments the length of the ring by one
- * 
+ *
  * @param  {T} ring   Ring_T ring
  * @param  {void *} x   Pointer to element to add to ring
  * @return      [description]
  */
 void *Ring_addlo (T ring, void *x) {
 	assert(ring);
-	Ring_addhi(ring, x);
-	ring->head = ring->head->llink;
+	if (ring->head && ring->head->n < NVALUES)
+		insert(ring, ring->head, 0, x);
+	else { // x goes in a new node that becomes the head
+		Ring_addhi(ring, x);
+		if (ring->head->llink->n == 1)
+			ring->head = ring->head->llink;
+		else
+			ring->head = split(ring, ring->head->llink, ring->head->llink->n - 1);
+	}
+
 	return x;
 }
 
 
 /**
- * Deallocates the Ring pointer by ring and clears the pointer.
+ * Deallocates the Ring pointer by ring and clears the pointer. The nodes are
+ * released a block at a time, without walking the ring.
  * @param {T} ring   Pointer to Ring_T
  */
 void Ring_free (T *ring) {
-	struct node *p, *q;
+	struct block *b, *link;
 
 	assert(ring && *ring);
-	if ((p = (*ring)->head) != NULL) {
-		int n = (*ring)->length;
-		for ( ; n-- > 0; p = q) {
-			q = p->rlink;
-			FREE(p);
-		}
+	for (b = (*ring)->blocks; b; b = link) {
+		link = b->link;
+		FREE(b);
 	}
 	FREE(*ring);
 }
@@ -158,27 +356,20 @@ void Ring_free (T *ring) {
  */
 void *Ring_get (T ring, int i) {
 	struct node *q;
+	int k;
 
 	assert(ring);
 	assert(i >= 0 && i < ring->length);
-	// q <- ith node
-	{
-		int n;
-		q = ring->head;
-		if (i <= ring->length/2)
-			for (n = i; n-- > 0; )
-				q = q->rlink;
-		else
-			for (n = ring->length - i; n-- > 0; )
-				q = q->llink;
-	}
+	// q <- node of the ith value
+	q = locate(ring, i, &k);
 
+	return q->value[k];
 }
 
 
 /**
  * Returns the number of values in ring
- * 
+ *
  * @param  {T} ring   Ring_T ring
  * @return      Number of values in ring
  */
@@ -190,7 +381,7 @@ int Ring_length (T ring) {
 
 /**
  * Creates and returns an empty ring
- * 
+ *
  * @return  Empty ring
  */
 T Ring_new (void) {
@@ -204,7 +395,7 @@ T Ring_new (void) {
 
 /**
  * Changes the ith value in ring to x and returns the previous value
- * 
+ *
  * @param  {T} ring   Ring_T ring
  * @param  {int} i   Index of ring to store x
  * @param  {void *} x   Pointer to value to store in ring
@@ -213,23 +404,15 @@ T Ring_new (void) {
 void *Ring_put (T ring, int i, void *x) {
 	struct node *q;
 	void *prev;
+	int k;
 
 	assert(ring);
 	assert(i >= 0 && i < ring->length);
-	// q <- ith node
-	{
-		int n;
-		q = ring->head;
-		if (i <= ring->length/2
-)			for (n = i; n-- > 0; )
-				q = q->rlink;
-		else
-			for (n = ring->length - i; n-- > 0; )
-				q = q->llink;
-	}
+	// q <- node of the ith value
+	q = locate(ring, i, &k);
 
-	prev = q->value;
-	q->value = x;
+	prev = q->value[k];
+	q->value[k] = x;
 	return prev;
 }
 
@@ -237,41 +420,32 @@ void *Ring_put (T ring, int i, void *x) {
 /**
  * Remove and return the element at the high end of ring. Removing the value at
  * the end of ring decrements the ring's length by one
- * 
+ *
  * @param  {T} ring   Ring_T ring
  * @return      Removed element
  */
 void *Ring_remhi (T ring) {
-	void *x;
 	struct node *q;
 
 	assert(ring);
 	assert(ring->length > 0);
 	q = ring->head->llink;
-	x = q->value;
-	// delete node q
-	q->llink->rlink = q->rlink;
-	q->rlink->llink = q->llink;
-	FREE(q);
-	if (--ring->length == 0)
-		ring->head = NULL;
 
-	return x;
+	return delete(ring, q, q->n - 1);
 }
 
 /**
  * Remove and return the element at the low end of ring. Removing the value at
  * the begining of ring decrements the ring's length by one
- * 
+ *
  * @param  {T} ring   Ring_T ring
  * @return      Removed element
  */
 void *Ring_remlo (T ring) {
 	assert(ring);
 	assert(ring->length > 0);
-	ring->head = ring->head->rlink;
 
-	return Ring_remhi(ring);
+	return delete(ring, ring->head, 0);
 }
 
 
@@ -279,42 +453,22 @@ void *Ring_remlo (T ring) {
  * Removes and returns the ith value in ring. Removing a value decrements the
  * indices of the remaining values to its right by one and the length of the ring
  * by one
- * 
+ *
  * @param  {T} ring   Ring_T ring
  * @param  {int} i   Index of element to remove
  * @return      Removed element
  */
 void *Ring_remove (T ring, int i) {
-	void *x;
 	struct node *q;
+	int k;
 
 	assert(ring);
 	assert(ring->length > 0);
 	assert(i >= 0 && i < ring->length);
-	// q <- ith node
-	{
-		int n;
-		q = ring->head;
-		if (i <= ring->length/2)
-			for (n = i; n-- > 0; )
-				q = q->rlink;
-		else
-			for (n = ring->length - i; n-- > 0; )
-				q = q->llink;
-	}
-
-	if (i == 0)
-		ring->head = ringth->head->rlink;
-
-	x = q->value;
-	// delete node q
-	q->llink->rlink = q->rlink;
-	q->rlink->llink = q->llink;
-	FREE(q);
-	if (--ring->length == 0)
-		ring->head = NULL;
+	// q <- node of the ith value
+	q = locate(ring, i, &k);
 
-	return x;
+	return delete(ring, q, k);
 }
 
 
@@ -352,33 +506,35 @@ T Ring_ring (void *x, ...) {
  * them left or right. If n is positive, ring is rotated to the right - clockwise -
  * n values, and the indices of each value are incremented by n modulo the length
  * of ring
- * 
+ *
+ * The node that holds the new value zero is split so that value starts a node,
+ * and the values left behind are merged into their left neighbor when they fit,
+ * so repeated rotations do not fragment the ring.
+ *
  * @param {T} ring   Ring_T ring
- * @param {int} n   Number of positions to rotate 
+ * @param {int} n   Number of positions to rotate
  */
 void Ring_rotate (T ring, int n) {
 	struct node *q;
-	int i;
+	int i, k;
 
 	assert(ring);
 	assert(n >= -ring->length && n <= ring->length);
+	if (ring->length == 0)
+		return;
 	if (n >= 0)
 		i = n % ring->length;
 	else
 		i = n + ring->length;
 
-	// q <- ith node
-	{
-		int n;
-		q = ring->head;
-		if (i <= ring->length/2)
-			for (n = i; n-- > 0; )
-				q = q->rlink;
-		else
-			for (n = ring->length - i; n-- > 0; )
-				q = q->llink;
-	}
+	// q <- node of the ith value
+	q = locate(ring, i, &k);
 
-	ring->head = q;
+	if (k == 0)
+		ring->head = q;
+	else {
+		ring->head = split(ring, q, k);
+		merge(ring, q->llink, NVALUES);
+	}
 }
 
@@ -1,4 +1,4 @@
-#ifndef RING_ICLUDED
+#ifndef RING_INCLUDED
 #define RING_INCLUDED
 
 #define T Ring_T
@@ -0,0 +1,426 @@
+/**
+ * ringtree is a second implementation of the Ring interface in which every
+ * positional operation takes O(log N) expected time. It is selected at link time,
+ * the way memchk.c replaces mem.c: link ringtree.o instead of ring.o.
+ *
+ * The values are kept in a treap, a binary tree that is ordered by position and
+ * heap-ordered by random priorities, so it stays balanced with high probability.
+ * Each node records the size of its subtree, which finds the value at a position
+ * in one walk from the root, and insertions and deletions split the tree at a
+ * position and merge the pieces back.
+ *
+ * Rotating does not move any values. The tree holds the values in the order they
+ * had before any rotation, and offset is the tree position of value zero, so the
+ * ith value of the ring is at tree position (offset + i) modulo the length and
+ * Ring_rotate only changes offset.
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "assert.h"
+#include "ring.h"
+#include "mem.h"
+
+#define T Ring_T
+
+#define NBLOCK 128
+#define size(t) ((t) ? (t)->size : 0)
+
+struct T {
+	struct node {
+		struct node *left, *right;
+		unsigned priority;
+		int size; // number of nodes in this subtree
+		void *value;
+	} *root;
+	int length;
+	int offset;
+	struct node *free; // unused nodes, linked by left
+	struct block *blocks;
+	int nblock; // nodes in the next block; zero before the first
+};
+
+/**
+ * Nodes are allocated a block at a time and recycled through a per-ring free
+ * list, as in ring.c, so steady add/remove churn does not call Mem. Blocks
+ * double from one node up to NBLOCK, so small rings stay small.
+ */
+struct block {
+	struct block *link;
+	struct node nodes[];
+};
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the next number of a xorshift generator, used for node priorities
+ */
+static unsigned rnd (void) {
+	static unsigned x = 2463534242U;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+
+/**
+ * Splits tree t into l, which holds its first k nodes, and r, which holds the rest
+ */
+static void split (struct node *t, int k, struct node **l, struct node **r) {
+	if (t == NULL)
+		*l = *r = NULL;
+	else if (size(t->left) < k) {
+		split(t->right, k - size(t->left) - 1, &t->right, r);
+		t->size = size(t->left) + 1 + size(t->right);
+		*l = t;
+	} else {
+		split(t->left, k, l, &t->left);
+		t->size = size(t->left) + 1 + size(t->right);
+		*r = t;
+	}
+}
+
+
+/**
+ * Returns the tree that holds the nodes of l followed by the nodes of r
+ */
+static struct node *merge (struct node *l, struct node *r) {
+	if (l == NULL)
+		return r;
+	if (r == NULL)
+		return l;
+	if (l->priority > r->priority) {
+		l->right = merge(l->right, r);
+		l->size = size(l->left) + 1 + size(l->right);
+		return l;
+	} else {
+		r->left = merge(l, r->left);
+		r->size = size(r->left) + 1 + size(r->right);
+		return r;
+	}
+}
+
+
+/**
+ * Returns the node at tree position k
+ */
+static struct node *nth (struct node *t, int k) {
+	while (k != size(t->left))
+		if (k < size(t->left))
+			t = t->left;
+		else {
+			k -= size(t->left) + 1;
+			t = t->right;
+		}
+
+	return t;
+}
+
+
+/**
+ * Returns the node that holds the ith value of ring
+ */
+static struct node *locate (T ring, int i) {
+	assert(i >= 0 && i < ring->length);
+	i += ring->offset;
+	if (i >= ring->length)
+		i -= ring->length;
+
+	return nth(ring->root, i);
+}
+
+
+/**
+ * Allocates a block of nodes and adds them to the free list of ring
+ */
+static void refill (T ring) {
+	struct block *b;
+	int i, n = ring->nblock ? ring->nblock : 1;
+
+	b = ALLOC(sizeof (*b) + n*sizeof (b->nodes[0]));
+	b->link = ring->blocks;
+	ring->blocks = b;
+	for (i = 0; i < n; i++) {
+		b->nodes[i].left = ring->free;
+		ring->free = &b->nodes[i];
+	}
+	ring->nblock = n < NBLOCK ? 2*n : NBLOCK;
+}
+
+
+/**
+ * Inserts x in ring so it becomes the ith value, 0 <= i <= length
+ */
+static void *insert (T ring, int i, void *x) {
+	struct node *p, *l, *r;
+	int k = ring->offset + i;
+
+	assert(i >= 0 && i <= ring->length);
+	// the ith value wraps around to the tree positions before offset
+	if (k > ring->length) {
+		k -= ring->length;
+		ring->offset++;
+	}
+
+	if (ring->free == NULL)
+		refill(ring);
+	p = ring->free;
+	ring->free = p->left;
+	p->left = p->right = NULL;
+	p->priority = rnd();
+	p->size = 1;
+	p->value = x;
+	split(ring->root, k, &l, &r);
+	ring->root = merge(merge(l, p), r);
+	ring->length++;
+
+	return x;
+}
+
+
+/**
+ * Removes and returns the ith value of ring
+ */
+static void *delete (T ring, int i) {
+	struct node *l, *m, *r;
+	void *x;
+	int k = ring->offset + i;
+
+	assert(i >= 0 && i < ring->length);
+	if (k >= ring->length)
+		k -= ring->length;
+
+	split(ring->root, k, &l, &r);
+	split(r, 1, &m, &r);
+	ring->root = merge(l, r);
+	x = m->value;
+	m->left = ring->free;
+	ring->free = m;
+
+	if (k < ring->offset)
+		ring->offset--;
+	if (--ring->length == 0 || ring->offset >= ring->length)
+		ring->offset = 0;
+
+	return x;
+}
+
+
+///////////////
+// functions //
+///////////////
+
+/**
+ * Adds x to ring at position pos and returns x. Positions are as in ring.c:
+ * position 1 and position -N are before the first value, and positions 0 and
+ * N+1 are after the last one
+ *
+ * @param  {T} ring   Ring_T ring
+ * @param  {int} pos   Position to add x
+ * @param  {void *} x   Pointer of element to add to ring
+ * @return      x
+ */
+void *Ring_add (T ring, int pos, void *x) {
+	assert(ring);
+	assert(pos >= -ring->length && pos <= ring->length+1);
+
+	if (pos == 0)
+		return insert(ring, ring->length, x);
+	else
+		return insert(ring, pos < 0 ? pos + ring->length : pos - 1, x);
+}
+
+
+/**
+ * Adds x to the high end of ring and returns x
+ *
+ * @param  {T} ring   Ring_T ring
+ * @param  {void *} x   Pointer to element to add to ring
+ * @return      x
+ */
+void *Ring_addhi (T ring, void *x) {
+	assert(ring);
+	return insert(ring, ring->length, x);
+}
+
+
+/**
+ * Adds x to the low end of ring and returns x
+ *
+ * @param  {T} ring   Ring_T ring
+ * @param  {void *} x   Pointer to element to add to ring
+ * @return      x
+ */
+void *Ring_addlo (T ring, void *x) {
+	assert(ring);
+	return insert(ring, 0, x);
+}
+
+
+/**
+ * Deallocates the Ring pointer by ring and clears the pointer. The nodes are
+ * released a block at a time, without walking the tree.
+ *
+ * @param {T} ring   Pointer to Ring_T
+ */
+void Ring_free (T *ring) {
+	struct block *b, *link;
+
+	assert(ring && *ring);
+	for (b = (*ring)->blocks; b; b = link) {
+		link = b->link;
+		FREE(b);
+	}
+	FREE(*ring);
+}
+
+
+/**
+ * Returns the ith value in ring
+ *
+ * @param  {T} ring   Ring_T ring
+ * @param  {int} i   Index of value in ring
+ * @return      ith value in ring
+ */
+void *Ring_get (T ring, int i) {
+	assert(ring);
+	assert(i >= 0 && i < ring->length);
+	return locate(ring, i)->value;
+}
+
+
+/**
+ * Returns the number of values in ring
+ *
+ * @param  {T} ring   Ring_T ring
+ * @return      Number of values in ring
+ */
+int Ring_length (T ring) {
+	assert(ring);
+	return ring->length;
+}
+
+
+/**
+ * Creates and returns an empty ring
+ *
+ * @return  Empty ring
+ */
+T Ring_new (void) {
+	T ring;
+
+	NEW0(ring);
+	ring->root = NULL;
+	return ring;
+}
+
+
+/**
+ * Changes the ith value in ring to x and returns the previous value
+ *
+ * @param  {T} ring   Ring_T ring
+ * @param  {int} i   Index of ring to store x
+ * @param  {void *} x   Pointer to value to store in ring
+ * @return      Previous ith value of ring
+ */
+void *Ring_put (T ring, int i, void *x) {
+	struct node *q;
+	void *prev;
+
+	assert(ring);
+	assert(i >= 0 && i < ring->length);
+	q = locate(ring, i);
+	prev = q->value;
+	q->value = x;
+	return prev;
+}
+
+
+/**
+ * Removes and returns the value at the high end of ring
+ *
+ * @param  {T} ring   Ring_T ring
+ * @return      Removed element
+ */
+void *Ring_remhi (T ring) {
+	assert(ring);
+	assert(ring->length > 0);
+	return delete(ring, ring->length - 1);
+}
+
+
+/**
+ * Removes and returns the value at the low end of ring
+ *
+ * @param  {T} ring   Ring_T ring
+ * @return      Removed element
+ */
+void *Ring_remlo (T ring) {
+	assert(ring);
+	assert(ring->length > 0);
+	return delete(ring, 0);
+}
+
+
+/**
+ * Removes and returns the ith value in ring
+ *
+ * @param  {T} ring   Ring_T ring
+ * @param  {int} i   Index of element to remove
+ * @return      Removed element
+ */
+void *Ring_remove (T ring, int i) {
+	assert(ring);
+	assert(ring->length > 0);
+	assert(i >= 0 && i < ring->length);
+	return delete(ring, i);
+}
+
+
+/**
+ * Creates and returns a ring whose values are initialized to its non-null pointer
+ * arguments. The argument list is terminated by the first null pointer argument.
+ *
+ * @param {void *, ...} x   Argument list pointers to create a Ring
+ * @return      Ring initialized with x arguments
+ */
+T Ring_ring (void *x, ...) {
+	va_list ap;
+	T ring = Ring_new();
+
+	va_start(ap, x);
+	for ( ; x; x = va_arg(ap, void *))
+		Ring_addhi(ring, x);
+
+	va_end(ap);
+	return ring;
+}
+
+
+/**
+ * Renumbers the values in ring by rotating them n positions, as in ring.c. Only
+ * the offset of value zero changes, so Ring_rotate takes constant time.
+ *
+ * @param {T} ring   Ring_T ring
+ * @param {int} n   Number of positions to rotate
+ */
+void Ring_rotate (T ring, int n) {
+	int i;
+
+	assert(ring);
+	assert(n >= -ring->length && n <= ring->length);
+	if (ring->length == 0)
+		return;
+	if (n >= 0)
+		i = n % ring->length;
+	else
+		i = n + ring->length;
+
+	ring->offset = (ring->offset + i) % ring->length;
+}
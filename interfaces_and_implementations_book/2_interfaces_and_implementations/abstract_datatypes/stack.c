@@ -1,18 +1,36 @@
 #include <stddef.h>
+#include <string.h>
 #include "assert.h"
 #include "mem.h"
 #include "stack.h"
 
 #define T Stack_T
 
+// <macros>
+
+#define MINCAPACITY 16
+
 // <types>
 
+// The elements live in one contiguous array: elems[0..count-1] holds the stack,
+// with the top at elems[count-1]. The array doubles when it fills, so a push is
+// a store and an increment, and the allocator is called only O(log N) times
 struct T {
 	int count;
-	struct elem {
-		void *x;
-		struct elem *link;
-	} *head;
+	int capacity;
+	void **elems;
+};
+
+// <static functions>
+
+// grow makes room for at least n more elements by doubling the capacity
+static void grow(T stk, int n){
+	int capacity = stk->capacity;
+
+	while(capacity - stk->count < n)
+		capacity *= 2;
+	RESIZE(stk->elems, (long)capacity * sizeof (*stk->elems));
+	stk->capacity = capacity;
 }
 
 // <functions>
@@ -22,7 +40,8 @@ T Stack_new(void){
 	T stk;
 	NEW(stk); // NEW -> allocation macro from Mem interface
 	stk->count = 0;
-	stk->head = NULL;
+	stk->capacity = MINCAPACITY;
+	stk->elems = ALLOC(MINCAPACITY * sizeof (*stk->elems));
 	return stk;
 }
 
@@ -33,41 +52,51 @@ int Stack_empty(T stk){
 	return stk->count == 0;
 }
 
-// Stack_push and Stack_pop add and remove elements from the head
-// of the linked list emanating from stk->head
+// Stack_push and Stack_pop add and remove elements at the top of the array;
+// neither one allocates unless Stack_push finds the array full
 void Stack_push(T stk, void *x){
-	struct elem *t;
-
 	assert(stk);
-	NEW(t);
-	t->x = x;
-	t->link = stk->head;
-	stk->head = t;
-	stk->count ++;
+	if(stk->count == stk->capacity)
+		grow(stk, 1);
+	stk->elems[stk->count++] = x;
 }
 
 void *Stack_pop(T stk){
-	void *x;
-	struct elem *t;
 	assert(stk);
 	assert(stk->count > 0);
-	t = stk->head;
-	stk->head = t->link;
-	stk->count--;
-	x = t->x;
-	FREE(t); // deallocates space pointed to by its pointer argument, then sets the argument to the null
-			 // pointer
-	return x;
+	return stk->elems[--stk->count];
+}
+
+// Stack_pushv pushes x[0], x[1], ..., x[n-1] in that order, so x[n-1] ends up on
+// top, with at most one reallocation and one copy
+void Stack_pushv(T stk, void **x, int n){
+	assert(stk);
+	assert(n >= 0);
+	assert(x || n == 0);
+	if(stk->capacity - stk->count < n)
+		grow(stk, n);
+	memcpy(stk->elems + stk->count, x, n * sizeof (*x));
+	stk->count += n;
 }
 
+// Stack_popv pops up to n elements into out[0..] in pop order, so out[0] is the
+// former top, and returns how many it popped
+int Stack_popv(T stk, void **out, int n){
+	int i;
 
-void Stack_free(T *stk){
-	struct elem *t, *u;
+	assert(stk);
+	assert(n >= 0);
+	assert(out || n == 0);
+	if(n > stk->count)
+		n = stk->count;
+	for(i = 0; i < n; i++)
+		out[i] = stk->elems[--stk->count];
+	return n;
+}
 
+void Stack_free(T *stk){
 	assert(stk && *stk);
-	for(t = (*stk)->head; t; t = u){
-		u = t->link;
-		FREE(t);
-	}
+	FREE((*stk)->elems); // deallocates space pointed to by its pointer argument, then sets the argument
+						 // to the null pointer
 	FREE(*stk);
-}
\ No newline at end of file
+}
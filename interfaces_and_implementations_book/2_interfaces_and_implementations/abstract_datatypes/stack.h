@@ -14,6 +14,8 @@ extern int 		Stack_empty (T stk);
 extern void		Stack_push	(T stk, void *x);
 extern void	   *Stack_pop	(T stk);
 extern void		Stack_free	(T *stk);
+extern void		Stack_pushv	(T stk, void **x, int n);
+extern int		Stack_popv	(T stk, void **out, int n);
 
 #undef T
 #endif
\ No newline at end of file
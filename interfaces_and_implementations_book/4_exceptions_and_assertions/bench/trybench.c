@@ -0,0 +1,96 @@
+/**
+ * trybench measures the cost of entering and leaving a TRY statement that does not
+ * raise, and of a TRY whose body raises. Build it once as is and once with
+ * -DEXCEPT_SETJMP, which makes TRY use setjmp and longjmp:
+ *
+ * 		cc ... bench/trybench.c except.c                 -o trybench
+ * 		cc ... -DEXCEPT_SETJMP bench/trybench.c except.c -o trybench-setjmp
+ *
+ * 		trybench [n]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "assert.h"
+#include "except.h"
+
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+static const Except_T Failed = { "Failed" };
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the wall clock time in seconds
+ */
+static double now (void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Returns x + 1, and raises Failed when raise is nonzero. It is not inlined, as
+ * the body of a TRY in a real program would call out
+ */
+static NOINLINE long step (long x, int raise) {
+	if (raise)
+		RAISE(Failed);
+	return x + 1;
+}
+
+
+//////////
+// main //
+//////////
+
+int main (int argc, char *argv[]) {
+	long i, n = 50000000;
+	volatile long sum = 0, nraised = 0;
+	double t;
+
+	if (argc >= 2)
+		n = atol(argv[1]);
+	assert(n > 0);
+
+	t = now();
+	for (i = 0; i < n; i++)
+		sum = step(sum, 0);
+	t = now() - t;
+	printf("no TRY       %6.2f ns\n", t / n * 1e9);
+
+	t = now();
+	for (i = 0; i < n; i++) {
+		TRY
+			sum = step(sum, 0);
+		EXCEPT(Failed)
+			nraised++;
+		END_TRY;
+	}
+	t = now() - t;
+	printf("TRY          %6.2f ns\n", t / n * 1e9);
+
+	t = now();
+	for (i = 0; i < n / 10; i++) {
+		TRY
+			sum = step(sum, 1);
+		EXCEPT(Failed)
+			nraised++;
+		END_TRY;
+	}
+	t = now() - t;
+	printf("TRY + RAISE  %6.2f ns\n", t / (n / 10) * 1e9);
+
+	assert(sum == 2*n && nraised == n / 10);
+	return EXIT_SUCCESS;
+}
@@ -32,5 +32,5 @@ void Except_raise(const T *e, const char *file, int line) {
 	// pop
 	Except_stack = Except_stack->prev;
 
-	longjmp(p->env, Except_raised);
+	Except_longjmp(p->env);
 }
\ No newline at end of file
@@ -16,11 +16,32 @@ typedef struct T {
 } T;
 
 
+/* TRY saves the registers with setjmp on every entry, even though most TRY
+ * statements finish without a raise. Under GCC and Clang, the environment is saved
+ * with __builtin_setjmp instead, which is inlined where TRY appears and stores only
+ * the frame pointer, the stack pointer and the resume address. The callee-saved
+ * registers are saved once, in the prologue of each function that contains a TRY,
+ * and restored by its epilogue, so neither TRY nor RAISE saves or restores them;
+ * __builtin_longjmp only reloads the three saved words. __builtin_longjmp always
+ * makes __builtin_setjmp return 1, which is Except_raised. Defining EXCEPT_SETJMP
+ * selects setjmp and longjmp; it must be defined for the whole program, since it
+ * changes the layout of Except_Frame.
+ */
+#if defined(__GNUC__) && !defined(EXCEPT_SETJMP)
+typedef void *Except_jmp_buf[5];
+#define Except_setjmp(env) __builtin_setjmp(env)
+#define Except_longjmp(env) __builtin_longjmp((env), 1)
+#else
+typedef jmp_buf Except_jmp_buf;
+#define Except_setjmp(env) setjmp(env)
+#define Except_longjmp(env) longjmp((env), Except_raised)
+#endif
+
 //<exported types>
 typedef struct Except_Frame Except_Frame;
 struct Except_Frame {
 	Except_Frame *prev;
-	jmp_buf env;
+	Except_jmp_buf env;
 	const char *file;
 	int line;
 	const T *exception;
@@ -50,7 +71,7 @@ void Except_raise(const T *e, const char *file, int line);
 	Except_Frame Except_frame; \
 	Except_frame.prev = Except_stack; /*push*/ \
 	Except_stack = &Except_frame; \
-	Except_flag = setjmp(Except_frame.env); \
+	Except_flag = Except_setjmp(Except_frame.env); \
 	if (Except_flag == Except_entered) {
 
 #define EXCEPT(e) \
@@ -69,7 +90,7 @@ void Except_raise(const T *e, const char *file, int line);
 		if (Except_flag == Except_entered) /*<pop>*/ \
 			Except_stack = Except_stack->prev; \
 	} { \
-		if (Except_flag == Except_enetered) \
+		if (Except_flag == Except_entered) \
 			Except_flag = Except_finalized;
 
 #define END_TRY \
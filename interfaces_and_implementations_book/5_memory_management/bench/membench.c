@@ -0,0 +1,166 @@
+/**
+ * membench times the allocation pattern of the word-frequency (wf) and
+ * cross-reference (xref) programs through the Mem interface, so the same source
+ * measures whichever implementation it is linked with:
+ *
+ * 		cc ... bench/membench.c mem.c     -o membench-malloc
+ * 		cc ... bench/membench.c memslab.c -o membench-slab
+ *
+ * 		membench [nwords [nrounds]]
+ *
+ * Each round reads nwords words drawn from a Zipf-like vocabulary. wf allocates
+ * an atom (the word's string) and a table binding and a count the first time it
+ * sees a word; xref also keeps, for every word, a set of line numbers whose
+ * members and bindings are allocated on each occurrence. Table buckets grow as
+ * the vocabulary grows. At the end of the round every block is freed, as the
+ * programs do when they print their results.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "assert.h"
+#include "mem.h"
+
+#define NBUCKETS (1 << 20)
+
+
+///////////
+// types //
+///////////
+
+// One entry per distinct word, shaped like a Table binding that holds the atom,
+// the wf count and the xref set of lines
+struct binding {
+	struct binding *link;
+	char *atom;
+	int *count;
+	struct member {
+		struct member *link;
+		int *line;
+	} *lines;
+};
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the wall clock time in seconds
+ */
+static double now (void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Returns a word number; small numbers are much more frequent than large ones
+ */
+static unsigned word (unsigned *seed, unsigned nvocab) {
+	double u;
+
+	*seed = *seed * 1103515245 + 12345;
+	u = (*seed >> 8) / (double)(1 << 24);
+	return (unsigned)(nvocab * u * u * u);
+}
+
+
+/**
+ * Runs one round of nwords words and frees everything it allocated
+ */
+static void round_ (int nwords, unsigned seed) {
+	struct binding **buckets, *b, *next;
+	struct member *m, *mnext;
+	unsigned nvocab = nwords / 4 + 1;
+	int i, nbuckets = 64, nbindings = 0;
+
+	buckets = CALLOC(nbuckets, sizeof (*buckets));
+	for (i = 0; i < nwords; i++) {
+		unsigned w = word(&seed, nvocab), h = w % nbuckets;
+
+		for (b = buckets[h]; b; b = b->link)
+			if (*b->count == (int)w)
+				break;
+
+		if (b == NULL) {
+			char buf[32];
+			int len = snprintf(buf, sizeof buf, "w%u%.*s", w, (int)(w % 11), "abcdefghijk");
+			char *atom = ALLOC(len + 1);
+
+			memcpy(atom, buf, len + 1);
+			NEW(b);
+			b->atom = atom;
+			NEW(b->count);
+			*b->count = w;
+			b->lines = NULL;
+			b->link = buckets[h];
+			buckets[h] = b;
+
+			// rehash into twice as many buckets when the table fills
+			if (++nbindings > nbuckets && nbuckets < NBUCKETS) {
+				struct binding **old = buckets;
+				int j, n = nbuckets;
+
+				nbuckets *= 2;
+				buckets = CALLOC(nbuckets, sizeof (*buckets));
+				for (j = 0; j < n; j++)
+					for (b = old[j]; b; b = next) {
+						next = b->link;
+						h = *b->count % nbuckets;
+						b->link = buckets[h];
+						buckets[h] = b;
+					}
+				FREE(old);
+				continue;
+			}
+		}
+
+		NEW(m);
+		NEW(m->line);
+		*m->line = i / 10;
+		m->link = b->lines;
+		b->lines = m;
+	}
+
+	for (i = 0; i < nbuckets; i++)
+		for (b = buckets[i]; b; b = next) {
+			next = b->link;
+			for (m = b->lines; m; m = mnext) {
+				mnext = m->link;
+				FREE(m->line);
+				FREE(m);
+			}
+			FREE(b->atom);
+			FREE(b->count);
+			FREE(b);
+		}
+	FREE(buckets);
+}
+
+
+//////////
+// main //
+//////////
+
+int main (int argc, char *argv[]) {
+	int r, nwords = 1000000, nrounds = 5;
+	double t;
+
+	if (argc >= 2)
+		nwords = atoi(argv[1]);
+	if (argc >= 3)
+		nrounds = atoi(argv[2]);
+	assert(nwords > 0 && nrounds > 0);
+
+	t = now();
+	for (r = 0; r < nrounds; r++)
+		round_(nwords, r + 1);
+	printf("%d rounds of %d words: %.1f ms\n", nrounds, nwords, (now() - t) * 1e3);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+/**
+ * mtbench times small-block allocation from several threads at once through the
+ * Mem interface. Build it once with mem.c, whose blocks come from malloc, and once
+ * with memslab.c:
+ *
+ * 		cc ... bench/mtbench.c mem.c     -lpthread -o mtbench-malloc
+ * 		cc ... bench/mtbench.c memslab.c -lpthread -o mtbench-slab
+ *
+ * 		mtbench [nops [maxthreads]]
+ *
+ * Each thread keeps a window of live blocks of random sizes up to 256 bytes and
+ * replaces a random one on every step, and every fourth block it frees was
+ * allocated by its neighbour thread, so blocks also migrate between threads. The
+ * benchmark reports the throughput for 1, 2, 4, ... maxthreads threads; with an
+ * allocator that scales, it grows with the number of cores.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "assert.h"
+#include "mem.h"
+
+#define NLIVE 1024
+
+
+///////////
+// types //
+///////////
+
+struct worker {
+	pthread_t thread;
+	unsigned seed;
+	long nops;
+	void *live[NLIVE];
+	struct worker *neighbour;
+	_Atomic(void *) handoff; // a block left by the neighbour for this worker
+};
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the wall clock time in seconds
+ */
+static double now (void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Returns the next number of a linear congruential generator
+ */
+static unsigned next (unsigned *seed) {
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+
+/**
+ * Runs the steps of one worker
+ */
+static void *work (void *cl) {
+	struct worker *w = cl;
+	long i;
+
+	for (i = 0; i < NLIVE; i++)
+		w->live[i] = ALLOC(1 + next(&w->seed) % 256);
+
+	for (i = 0; i < w->nops; i++) {
+		unsigned r = next(&w->seed), j = r % NLIVE;
+		void *p;
+
+		if ((i & 3) == 0) {
+			// hand this block to the neighbour and free whatever it left for us
+			p = atomic_exchange(&w->neighbour->handoff, w->live[j]);
+			if (p)
+				FREE(p);
+			p = atomic_exchange(&w->handoff, NULL);
+			if (p)
+				FREE(p);
+		} else
+			FREE(w->live[j]);
+		w->live[j] = ALLOC(1 + (r >> 10) % 256);
+	}
+
+	for (i = 0; i < NLIVE; i++)
+		FREE(w->live[i]);
+	return NULL;
+}
+
+
+//////////
+// main //
+//////////
+
+int main (int argc, char *argv[]) {
+	long nops = 4000000;
+	int i, n, maxthreads = 8;
+
+	if (argc >= 2)
+		nops = atol(argv[1]);
+	if (argc >= 3)
+		maxthreads = atoi(argv[2]);
+	assert(nops > 0 && maxthreads > 0);
+
+	for (n = 1; n <= maxthreads; n *= 2) {
+		struct worker *w = CALLOC(n, sizeof (*w));
+		double t;
+
+		for (i = 0; i < n; i++) {
+			w[i].seed = i + 1;
+			w[i].nops = nops / n;
+			w[i].neighbour = &w[(i + 1) % n];
+		}
+		t = now();
+		for (i = 0; i < n; i++)
+			assert(pthread_create(&w[i].thread, NULL, work, &w[i]) == 0);
+		for (i = 0; i < n; i++)
+			pthread_join(w[i].thread, NULL);
+		t = now() - t;
+		for (i = 0; i < n; i++)
+			if (w[i].handoff)
+				FREE(w[i].handoff);
+		printf("%2d threads %8.1f ms  %6.1f Mops/s\n", n, t * 1e3, nops / t / 1e6);
+		FREE(w);
+	}
+
+	return EXIT_SUCCESS;
+}
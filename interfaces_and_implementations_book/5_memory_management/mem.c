@@ -56,3 +56,29 @@ void *Mem_resize(void *ptr, long nbytes, const char *file, int line){
 	
 	return ptr;
 }
+
+// Blocks come from posix_memalign, so they can be released by Mem_free and
+// grown by Mem_resize like any other block; Mem_resize does not preserve the
+// alignment. align must be a power of two
+void *Mem_alloc_aligned(long nbytes, long align, const char *file, int line){
+	void *ptr = NULL;
+
+	assert(nbytes > 0);
+	assert(align > 0 && (align & (align - 1)) == 0);
+	if(align < (long)sizeof(void *))
+		align = sizeof(void *);
+	if(posix_memalign(&ptr, align, nbytes) != 0){ // <raise Mem_failed>
+		if(file == NULL){ RAISE(Mem_Failed); }
+		else { Except_raise(&Mem_Failed, file, line); }
+	}
+
+	return ptr;
+}
+
+// mem.c keeps no record of the blocks it allocates, so it has no leaks to
+// report and never calls apply; link memchk.o to find them
+void Mem_leak(void apply(const void *ptr, long size, const char *file, int line, void *cl), void *cl){
+	assert(apply);
+	(void)apply;
+	(void)cl;
+}
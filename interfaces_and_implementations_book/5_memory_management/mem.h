@@ -11,12 +11,15 @@ extern void *Mem_alloc(long nbytes, const char *file, int line);
 extern void *Mem_calloc(long count, long nbytes, const char *file, int line);
 extern void Mem_free(void *ptr, const char *file, int line);
 extern void *Mem_resize(void *ptr, long nbytes, const char *file, int line);
+extern void *Mem_alloc_aligned(long nbytes, long align, const char *file, int line);
+extern void Mem_leak(void apply(const void *ptr, long size, const char *file, int line, void *cl), void *cl);
 
 // <exported macros>
 #define ALLOC(nbytes) Mem_alloc((nbytes), __FILE__, __LINE__)
-#define CALLOC(count, bytes) Mem_calloc((count), (nbytes), __FILE__, __LINE__)
+#define CALLOC(count, nbytes) Mem_calloc((count), (nbytes), __FILE__, __LINE__)
 #define FREE(ptr) ((void)(Mem_free((ptr), __FILE__, __LINE__), (ptr) = 0))
 #define RESIZE(ptr, nbytes) ((ptr) = Mem_resize((ptr), (nbytes), __FILE__, __LINE__))
+#define ALLOC_ALIGNED(nbytes, align) Mem_alloc_aligned((nbytes), (align), __FILE__, __LINE__)
 
 #define NEW(p)  ((p) = ALLOC((long)sizeof *(p)))
 #define NEW0(p) ((p) = CALLOC(1, (long)sizeof *(p)))
@@ -1,9 +1,33 @@
+/**
+ * memchk is the checking implementation of the Mem interface: it records every
+ * allocation and reports the checked runtime errors that mem.c lets through,
+ * such as freeing a block twice or freeing a pointer Mem did not return. It is
+ * selected at link time: link memchk.o instead of mem.o.
+ *
+ * Compiled with -DMEMCHK_SAMPLE=N, memchk checks a sample of the allocations,
+ * chosen by bytes so that on average one allocation in every N bytes allocated
+ * is tracked, large blocks more often than small ones. Unsampled blocks come
+ * from malloc and cost a subtraction on top of it; Mem_free and Mem_resize
+ * tell them apart because they are not in htab. Double frees and leaks of the
+ * sampled blocks are still caught, which is enough to find them in a program
+ * that runs for long. The sample intervals are drawn from an exponential
+ * distribution, which makes the samples a Poisson process over the bytes
+ * allocated; link with -lm.
+ */
+
 #include <stdlib.h>
 #include <string.h>
 #include "assert.h"
 #include "except.h"
 #include "mem.h"
 
+#ifdef MEMCHK_SAMPLE
+#include <math.h>
+#define SAMPLING 1
+#else
+#define SAMPLING 0
+#endif
+
 // <checking types>
 union align {
 	int i;
@@ -14,16 +38,26 @@ union align {
 	float f;
 	double d;
 	long double ld;
-}
+};
 
 // <checking macros>
-#define hash(p, t) (((unsigned long)(p)>>3) & (sizeof(t)/sizeof((t)[0])-1))
+#define hash(p) (((unsigned long)(p)>>3) & (nbuckets - 1))
 #define NALLOC ((4096 + sizeof(union align) - 1) / (sizeof(union align))) * (sizeof(union align))
 #define NDESCRIPTORS 512
+#define NBINS ((int)(8*sizeof (unsigned long)))
+#define NSMALL 32
+#define SMALL (NSMALL*sizeof (union align))
 
 // <data>
 
+const Except_T Mem_Failed = { "Allocation Failed" };
+
 // <checking data>
+
+// Every block Mem has handed out has a descriptor in htab, found by hashing its
+// address. Descriptors are never removed, since a freed block's descriptor is
+// what catches a second free, so htab doubles whenever it averages two
+// descriptors per bucket
 static struct descriptor {
 	struct descriptor *free;
 	struct descriptor *link;
@@ -31,15 +65,28 @@ static struct descriptor {
 	long size;
 	const char *file;
 	int line;
-} *htab[2048];
-
-static struct descriptor freelist = { &freelist };
+} **htab;
+static unsigned long nbuckets, ndescriptors;
+
+// The free blocks are kept in segregated bins, linked through free and ending at
+// the bin itself so a free block's free field is never null. Block sizes are
+// multiples of union align, and below SMALL each size has a bin of its own:
+// bins[k] holds the blocks of k*sizeof (union align) bytes. Above, bins[NSMALL + j]
+// holds the blocks whose size is in [SMALL*2^j, SMALL*2^(j+1)), and the last bin
+// holds all the bigger ones. Bit k of nonempty is set when bins[k] has a block, so
+// the first bin whose blocks all satisfy a request is found without looking at
+// any block
+static struct descriptor bins[NBINS];
+static unsigned long nonempty;
 
 // <checking functions>
 
 static struct descriptor *find(const void *ptr){
-	struct descriptor *bp = htab[hash(ptr, htab)];
+	struct descriptor *bp;
 
+	if (htab == NULL)
+		return NULL;
+	bp = htab[hash(ptr)];
 	while(bp && bp->ptr != ptr)
 		bp = bp->link;
 
@@ -69,74 +116,201 @@ static struct descriptor *dalloc(void *ptr, long size, const char *file, int lin
 	return avail++;
 }
 
+// Adds bp to htab, doubling htab first if it is full. Returns zero if there is
+// no memory for a bigger table
+static int enter(struct descriptor *bp){
+	unsigned long h;
+
+	if (ndescriptors >= 2*nbuckets) {
+		unsigned long i, n = nbuckets ? 2*nbuckets : 2048;
+		struct descriptor **t = calloc(n, sizeof (*t)), *p, *link;
+
+		if (t == NULL)
+			return 0;
+		for (i = 0; i < nbuckets; i++)
+			for (p = htab[i]; p; p = link) {
+				link = p->link;
+				h = ((unsigned long)p->ptr>>3) & (n - 1);
+				p->link = t[h];
+				t[h] = p;
+			}
+		free(htab);
+		htab = t;
+		nbuckets = n;
+	}
+
+	h = hash(bp->ptr);
+	bp->link = htab[h];
+	htab[h] = bp;
+	ndescriptors++;
+	return 1;
+}
+
+// Returns the bin of the free blocks of size n
+static int binof(unsigned long n){
+	int k = NSMALL;
+
+	if (n < SMALL)
+		return n / sizeof (union align);
+	for (n /= SMALL; (n >>= 1) && k < NBINS - 1; k++)
+		;
+	return k;
+}
+
+// Puts the free block bp at the head of its bin
+static void bin(struct descriptor *bp){
+	int k = binof(bp->size);
+
+	if (bins[k].free == NULL)
+		bins[k].free = &bins[k];
+	bp->free = bins[k].free;
+	bins[k].free = bp;
+	nonempty |= 1UL << k;
+}
+
+// Removes and returns the block at the head of bins[k]
+static struct descriptor *unbin(int k){
+	struct descriptor *bp = bins[k].free;
+
+	bins[k].free = bp->free;
+	if (bins[k].free == &bins[k])
+		nonempty &= ~(1UL << k);
+	return bp;
+}
+
+// Returns the number of the lowest set bit of m, which is nonzero
+static int lowbit(unsigned long m){
+#if defined(__GNUC__)
+	return __builtin_ctzl(m);
+#else
+	int k = 0;
+
+	while ((m & 1) == 0) {
+		m >>= 1;
+		k++;
+	}
+	return k;
+#endif
+}
+
+// Removes and returns a free block bigger than nbytes, or returns null if there
+// is none. A small bin holds blocks of exactly one size, so the blocks in
+// binof(nbytes) are too small when nbytes is below SMALL; a larger bin may hold
+// blocks on both sides of nbytes, and is searched first fit, as the single free
+// list was. Every block in the bins above binof(nbytes) is bigger than nbytes,
+// and the first of those bins that is not empty is found from nonempty
+static struct descriptor *fit(long nbytes){
+	int k = binof(nbytes);
+	struct descriptor *bp, *prev = &bins[k];
+	unsigned long m;
+
+	if (k >= NSMALL && bins[k].free)
+		for (bp = bins[k].free; bp != &bins[k]; prev = bp, bp = bp->free)
+			if (bp->size > nbytes) {
+				prev->free = bp->free;
+				if (bins[k].free == &bins[k])
+					nonempty &= ~(1UL << k);
+				return bp;
+			}
+
+	k++;
+	m = k < NBINS ? nonempty & (~0UL << k) : 0;
+	return m ? unbin(lowbit(m)) : NULL;
+}
+
+#ifdef MEMCHK_SAMPLE
+// Returns nonzero if the allocation of nbytes is to be tracked. countdown is the
+// number of bytes left before the next sample; when an allocation crosses it, a
+// new interval is drawn from an exponential distribution of mean MEMCHK_SAMPLE
+static int sampled(long nbytes){
+	static unsigned long x = 88172645463325252UL;
+	static double countdown = -1;
+
+	if ((countdown -= nbytes) > 0)
+		return 0;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	countdown = -log(((x >> 11) + 0.5) / 9007199254740992.0) * (MEMCHK_SAMPLE);
+	return 1;
+}
+#else
+#define sampled(nbytes) 1
+#endif
+
 void *Mem_alloc(long nbytes, const char *file, int line){
 	struct descriptor *bp;
 	void *ptr;
 
 	assert(nbytes > 0);
+	if (!sampled(nbytes)) {
+		if ((ptr = malloc(nbytes)) == NULL) {
+			// <raise Mem_failed>
+			if (file == NULL) { RAISE(Mem_Failed); }
+			else { Except_raise(&Mem_Failed, file, line); }
+		}
+		return ptr;
+	}
 	// <round nbytes up to an alignment boundary>
 	nbytes = ((nbytes + sizeof(union align) - 1) / (sizeof(union align))) * (sizeof(union align));
 
-	for(bp = freelist.free; bp; bp = bp->free){
-		if(bp->size > nbytes){
-			
-			// <use the end of the block at bp->ptr>
-			bp->size -= nbytes;
-			ptr = (char *)bp->ptr + bp->size;
-			if ((bp = dalloc(ptr, nbytes, file, line)) != NULL) {
-				unsigned h = hash(ptr, htab);
-				bp->link = htap[h];
-				htap[h] = bp;
-				return ptr;
-
-			} else {
-
-				// <raise Mem_failed>
-				if (file == NULL){ RAISE(Mem_Failed); }
-				else { Except_raise(&Mem_Failed, file, line); }
-			}
-
+	// <bp <- a free block bigger than nbytes>
+	if ((bp = fit(nbytes)) == NULL) {
+		// <bp <- a block of size NALLOC + nbytes>
+		if((ptr = malloc(nbytes + NALLOC)) == NULL \
+			|| (bp = dalloc(ptr, nbytes + NALLOC, __FILE__, __LINE__)) == NULL){
+			if (file == NULL) { RAISE(Mem_Failed); }
+			else{ Except_raise(&Mem_Failed, file, line ); }
 		}
-		if (bp == &freelist){
-			struct descriptor *newptr;
-
-			// <newptr <- a block of size NALLOC + nbytes>
-			if((ptr = malloc(nbytes + NALLOC)) == NULL \
-				|| (newptr = dalloc(ptr, nbytes + NALLOC, __FILE__, __LINE__)) == NULL){
-				if (file == NULL) { RAISE(Mem_failed); }
-				else{ Except_raise(&Mem_failed, file, line ); }
-			}
+	}
 
-			newptr->free = freelist.free;
-			freelist.free = newptr;
-		}
+	// <use the end of the block at bp->ptr>
+	bp->size -= nbytes;
+	ptr = (char *)bp->ptr + bp->size;
+	bin(bp);
+	if ((bp = dalloc(ptr, nbytes, file, line)) == NULL || !enter(bp)) {
+		// <raise Mem_failed>
+		if (file == NULL){ RAISE(Mem_Failed); }
+		else { Except_raise(&Mem_Failed, file, line); }
 	}
-	assert(0);
 
-	return NULL;
+	return ptr;
 }
 
+// When sampling, a pointer that is not in htab is taken to be an unsampled
+// block and passed to free
 void Mem_free(void *ptr, const char *file, int line){
 	if(ptr){
-		struct descriptor *bp;
+		struct descriptor *bp = NULL;
 		// <set bp if ptr is valid>
-		if (((unsigned long)ptr)%(sizeof(union align)) != 0 || (bp = find(ptr)) == NULL || bp->free){
+		if (((unsigned long)ptr)%(sizeof(union align)) == 0 && (bp = find(ptr)) == NULL && SAMPLING){
+			free(ptr);
+			return;
+		}
+		if (bp == NULL || bp->free){
 			Except_raise(&Assert_Failed, file, line);
 		}
 
-		bp->free = freelist.free;
-		freelist.free = bp;
+		bin(bp);
 	}
 }
 
 void *Mem_resize(void *ptr, long nbytes, const char *file, int line){
-	struct descriptor *bp;
+	struct descriptor *bp = NULL;
 	void *newptr;
 
-	assert(pt);
-	assert(nbytes);
+	assert(ptr);
+	assert(nbytes > 0);
 	// <set if ptr is valid>
-	if (((unsigned long)ptr)%(sizeof(union align)) != 0 || (bp = find(ptr)) == NULL || bp->free){
+	if (((unsigned long)ptr)%(sizeof(union align)) == 0 && (bp = find(ptr)) == NULL && SAMPLING){
+		if ((newptr = realloc(ptr, nbytes)) == NULL) {
+			// <raise Mem_failed>
+			if (file == NULL) { RAISE(Mem_Failed); }
+			else { Except_raise(&Mem_Failed, file, line); }
+		}
+		return newptr;
+	}
+	if (bp == NULL || bp->free){
 		Except_raise(&Assert_Failed, file, line);
 	}
 
@@ -158,3 +332,49 @@ void *Mem_calloc(long count, long nbytes, const char *file, int line){
 
 	return ptr;
 }
+
+
+// Blocks stricter than union align get a block of their own, described like
+// any other allocation so Mem_free and Mem_resize check them as usual. Once
+// freed they join the free bins and are carved up by later allocations
+void *Mem_alloc_aligned(long nbytes, long align, const char *file, int line){
+	struct descriptor *bp;
+	void *ptr = NULL;
+
+	assert(nbytes > 0);
+	assert(align > 0 && (align & (align - 1)) == 0);
+	if (align <= (long)sizeof(union align))
+		return Mem_alloc(nbytes, file, line);
+	if (!sampled(nbytes)) {
+		if (posix_memalign(&ptr, align, nbytes) != 0) {
+			// <raise Mem_failed>
+			if (file == NULL) { RAISE(Mem_Failed); }
+			else { Except_raise(&Mem_Failed, file, line); }
+		}
+		return ptr;
+	}
+
+	// <round nbytes up to an alignment boundary>
+	nbytes = ((nbytes + sizeof(union align) - 1) / (sizeof(union align))) * (sizeof(union align));
+	if (posix_memalign(&ptr, align, nbytes) != 0 \
+		|| (bp = dalloc(ptr, nbytes, file, line)) == NULL || !enter(bp)){
+		// <raise Mem_failed>
+		if (file == NULL) { RAISE(Mem_Failed); }
+		else { Except_raise(&Mem_Failed, file, line); }
+	}
+
+	return ptr;
+}
+
+// Calls apply for every block that is allocated and not yet freed, which at
+// exit are the leaks; when sampling, only sampled blocks are reported
+void Mem_leak(void apply(const void *ptr, long size, const char *file, int line, void *cl), void *cl){
+	struct descriptor *bp;
+	unsigned long i;
+
+	assert(apply);
+	for (i = 0; i < nbuckets; i++)
+		for (bp = htab[i]; bp; bp = bp->link)
+			if (bp->free == NULL)
+				apply(bp->ptr, bp->size, bp->file, bp->line, cl);
+}
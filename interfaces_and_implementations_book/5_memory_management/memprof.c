@@ -0,0 +1,367 @@
+/**
+ * memprof is the profiling implementation of the Mem interface. Blocks come from
+ * malloc with a header in front that points to the counters of the call site that
+ * allocated them and holds their size, so Mem_free knows whose live bytes to
+ * take back. Mem_profile and Mem_pprof, declared in memprof.h, report the
+ * counters.
+ *
+ * Each thread keeps its own table of call sites, so allocating touches only
+ * counters that the thread alone writes: they are atomics only so that a report
+ * can read them while the program runs, and the thread updates them with
+ * relaxed loads and stores. A block may be freed by any thread, so the free
+ * counters are updated with relaxed atomic adds. The tables are never freed,
+ * and the sites of threads that have exited still appear in the reports. A
+ * report merges the sites of all threads by file name and line.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "assert.h"
+#include "except.h"
+#include "mem.h"
+#include "memprof.h"
+
+// <macros>
+
+#define NBUCKETS 1024
+#define ALIGNED 1 // set in the site pointer of blocks from Mem_alloc_aligned
+
+// <raise Mem_Failed>
+#define FAIL(file, line) do { \
+	if (file == NULL) { RAISE(Mem_Failed); } \
+	else { Except_raise(&Mem_Failed, file, line); } \
+} while (0)
+
+// <types>
+
+struct site {
+	struct site *link;
+	const char *file;
+	int line;
+	atomic_long nalloc, allocbytes; // written by the owning thread
+	atomic_long nfree, freebytes; // written by any thread
+};
+
+struct table {
+	struct table *next;
+	struct site *_Atomic buckets[NBUCKETS];
+};
+
+// The header of a block: 16 bytes on LP64 systems, which keeps the block
+// aligned like malloc's. For blocks from Mem_alloc_aligned, site has its ALIGNED
+// bit set and the word before the header holds the address to free
+struct header {
+	struct site *site;
+	long size;
+};
+
+// One call site of a report: the counters of a site summed over all threads
+struct entry {
+	const char *file;
+	int line;
+	long nalloc, allocbytes;
+	long nfree, freebytes;
+};
+
+// <data>
+
+const Except_T Mem_Failed = { "Allocation Failed" };
+
+static _Thread_local struct table *local;
+static struct table *tables;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// <static functions>
+
+/**
+ * Returns the calling thread's counters for the call site at file and line,
+ * creating them if needed. Returns null if there is no memory for them
+ */
+static struct site *lookup(const char *file, int line){
+	struct site *s;
+	unsigned long h;
+
+	if (local == NULL) {
+		if ((local = calloc(1, sizeof (*local))) == NULL)
+			return NULL;
+		pthread_mutex_lock(&lock);
+		local->next = tables;
+		tables = local;
+		pthread_mutex_unlock(&lock);
+	}
+
+	h = ((uintptr_t)file >> 3 ^ (unsigned long)line*2654435761UL) % NBUCKETS;
+	for (s = atomic_load_explicit(&local->buckets[h], memory_order_relaxed); s; s = s->link)
+		if (s->line == line && s->file == file)
+			return s;
+
+	if ((s = calloc(1, sizeof (*s))) == NULL)
+		return NULL;
+	s->file = file;
+	s->line = line;
+	s->link = atomic_load_explicit(&local->buckets[h], memory_order_relaxed);
+	atomic_store_explicit(&local->buckets[h], s, memory_order_release);
+	return s;
+}
+
+/**
+ * Charges a block of nbytes to the call site at file and line, and fills in the
+ * header at hp. flags is ALIGNED or zero. Returns zero if there is no memory
+ */
+static int charge(struct header *hp, long nbytes, int flags, const char *file, int line){
+	struct site *s = lookup(file, line);
+
+	if (s == NULL)
+		return 0;
+	atomic_store_explicit(&s->nalloc, atomic_load_explicit(&s->nalloc, memory_order_relaxed) + 1, memory_order_relaxed);
+	atomic_store_explicit(&s->allocbytes, atomic_load_explicit(&s->allocbytes, memory_order_relaxed) + nbytes, memory_order_relaxed);
+	hp->site = (struct site *)((uintptr_t)s | flags);
+	hp->size = nbytes;
+	return 1;
+}
+
+/**
+ * Credits the block with header hp back to the site that allocated it
+ */
+static void credit(struct header *hp){
+	struct site *s = (struct site *)((uintptr_t)hp->site & ~(uintptr_t)ALIGNED);
+
+	atomic_fetch_add_explicit(&s->nfree, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&s->freebytes, hp->size, memory_order_relaxed);
+}
+
+/**
+ * Compares two report entries by live bytes, largest first, then by total bytes
+ */
+static int cmp(const void *x, const void *y){
+	const struct entry *a = x, *b = y;
+	long la = a->allocbytes - a->freebytes, lb = b->allocbytes - b->freebytes;
+
+	if (la != lb)
+		return la < lb ? 1 : -1;
+	if (a->allocbytes != b->allocbytes)
+		return a->allocbytes < b->allocbytes ? 1 : -1;
+	return 0;
+}
+
+/**
+ * Sums the sites of all threads by file name and line into a new array sorted by
+ * cmp, stores its length in *n and returns it; the array is null if there are no
+ * sites. Raises Mem_Failed if there is no memory for it
+ */
+static struct entry *collect(int *n){
+	struct entry *e = NULL;
+	struct table *t;
+	struct site *s;
+	int i, j, size = 0;
+
+	*n = 0;
+	pthread_mutex_lock(&lock);
+	for (t = tables; t; t = t->next)
+		for (i = 0; i < NBUCKETS; i++)
+			for (s = atomic_load_explicit(&t->buckets[i], memory_order_acquire); s; s = s->link) {
+				const char *file = s->file ? s->file : "?";
+
+				for (j = 0; j < *n; j++)
+					if (e[j].line == s->line && strcmp(e[j].file, file) == 0)
+						break;
+				if (j == *n) {
+					if (*n == size) {
+						struct entry *p = realloc(e, (size = 2*size + 64) * sizeof (*e));
+
+						if (p == NULL) {
+							pthread_mutex_unlock(&lock);
+							free(e);
+							RAISE(Mem_Failed);
+						}
+						e = p;
+					}
+					memset(&e[j], 0, sizeof (e[j]));
+					e[j].file = file;
+					e[j].line = s->line;
+					(*n)++;
+				}
+				e[j].nalloc += atomic_load_explicit(&s->nalloc, memory_order_relaxed);
+				e[j].allocbytes += atomic_load_explicit(&s->allocbytes, memory_order_relaxed);
+				e[j].nfree += atomic_load_explicit(&s->nfree, memory_order_relaxed);
+				e[j].freebytes += atomic_load_explicit(&s->freebytes, memory_order_relaxed);
+			}
+	pthread_mutex_unlock(&lock);
+
+	if (e)
+		qsort(e, *n, sizeof (*e), cmp);
+	return e;
+}
+
+
+// <functions>
+
+void *Mem_alloc(long nbytes, const char *file, int line){
+	struct header *hp;
+
+	assert(nbytes > 0);
+	if ((hp = malloc(sizeof (*hp) + nbytes)) == NULL)
+		FAIL(file, line);
+	if (!charge(hp, nbytes, 0, file, line)) {
+		free(hp);
+		FAIL(file, line);
+	}
+
+	return hp + 1;
+}
+
+void *Mem_calloc(long count, long nbytes, const char *file, int line){
+	struct header *hp;
+
+	assert(count > 0);
+	assert(nbytes > 0);
+	if ((hp = calloc(1, sizeof (*hp) + count*nbytes)) == NULL)
+		FAIL(file, line);
+	if (!charge(hp, count*nbytes, 0, file, line)) {
+		free(hp);
+		FAIL(file, line);
+	}
+
+	return hp + 1;
+}
+
+void Mem_free(void *ptr, const char *file, int line){
+	struct header *hp;
+
+	(void)file;
+	(void)line;
+	if (ptr == NULL)
+		return;
+	hp = (struct header *)ptr - 1;
+	credit(hp);
+	if ((uintptr_t)hp->site & ALIGNED)
+		free(((void **)hp)[-1]);
+	else
+		free(hp);
+}
+
+// A resized block is charged to the call site of Mem_resize, and credited back
+// to the site that allocated it. If Mem_resize fails, the block is unchanged
+void *Mem_resize(void *ptr, long nbytes, const char *file, int line){
+	struct header *hp, old;
+	void *newptr;
+
+	assert(ptr);
+	assert(nbytes > 0);
+	hp = (struct header *)ptr - 1;
+	if ((uintptr_t)hp->site & ALIGNED) {
+		newptr = Mem_alloc(nbytes, file, line);
+		memcpy(newptr, ptr, nbytes < hp->size ? nbytes : hp->size);
+		Mem_free(ptr, file, line);
+		return newptr;
+	}
+
+	// the site is looked up before the block moves, so a failure leaves the
+	// block as it was; charge then finds the site and cannot fail
+	old = *hp;
+	if (lookup(file, line) == NULL || (hp = realloc(hp, sizeof (*hp) + nbytes)) == NULL)
+		FAIL(file, line);
+	credit(&old);
+	charge(hp, nbytes, 0, file, line);
+
+	return hp + 1;
+}
+
+// The block starts align bytes into a block from posix_memalign, which leaves
+// room for the header and, before it, the address to free; align is at least
+// twice the header here
+void *Mem_alloc_aligned(long nbytes, long align, const char *file, int line){
+	struct header *hp;
+	void *base = NULL;
+
+	assert(nbytes > 0);
+	assert(align > 0 && (align & (align - 1)) == 0);
+	if (align <= (long)sizeof (*hp))
+		return Mem_alloc(nbytes, file, line);
+	if (posix_memalign(&base, align, align + nbytes) != 0)
+		FAIL(file, line);
+	hp = (struct header *)((char *)base + align) - 1;
+	((void **)hp)[-1] = base;
+	if (!charge(hp, nbytes, ALIGNED, file, line)) {
+		free(base);
+		FAIL(file, line);
+	}
+
+	return hp + 1;
+}
+
+// memprof counts bytes per call site, not blocks, so it has no blocks to report;
+// Mem_profile shows the live bytes of each site instead, and apply is never called
+void Mem_leak(void apply(const void *ptr, long size, const char *file, int line, void *cl), void *cl){
+	assert(apply);
+	(void)apply;
+	(void)cl;
+}
+
+/**
+ * Writes a report of the allocation call sites to fp, one line per site, sorted
+ * by the bytes each still holds. A site is a file and line that called Mem; the
+ * report shows its live bytes and blocks, and the bytes and blocks it allocated
+ * in all. The report is a snapshot: other threads may allocate while it is made.
+ * Raises Mem_Failed if there is no memory to make it.
+ *
+ * @param {FILE *} fp   Stream to write the report to
+ */
+void Mem_profile(FILE *fp){
+	struct entry *e;
+	long live = 0, total = 0;
+	int i, n;
+
+	assert(fp);
+	e = collect(&n);
+	for (i = 0; i < n; i++) {
+		live += e[i].allocbytes - e[i].freebytes;
+		total += e[i].allocbytes;
+	}
+
+	fprintf(fp, "%14s %12s %16s %12s  %s\n", "live bytes", "live blocks", "total bytes", "allocs", "site");
+	for (i = 0; i < n; i++)
+		fprintf(fp, "%14ld %12ld %16ld %12ld  %s:%d\n",
+			e[i].allocbytes - e[i].freebytes, e[i].nalloc - e[i].nfree,
+			e[i].allocbytes, e[i].nalloc, e[i].file, e[i].line);
+	fprintf(fp, "%14ld %12s %16ld %12s  total\n", live, "", total, "");
+	free(e);
+}
+
+/**
+ * Writes the call sites to fp as a heap profile in pprof's legacy text format,
+ * preceded by a symbol section, so pprof can read it without the binary. Each
+ * site stands for a one-frame stack whose address is its index and whose symbol
+ * is its file and line. Raises Mem_Failed if there is no memory to make it.
+ *
+ * @param {FILE *} fp   Stream to write the profile to
+ */
+void Mem_pprof(FILE *fp){
+	struct entry *e;
+	long nlive = 0, live = 0, nalloc = 0, total = 0;
+	int i, n;
+
+	assert(fp);
+	e = collect(&n);
+	for (i = 0; i < n; i++) {
+		nlive += e[i].nalloc - e[i].nfree;
+		live += e[i].allocbytes - e[i].freebytes;
+		nalloc += e[i].nalloc;
+		total += e[i].allocbytes;
+	}
+
+	fprintf(fp, "--- symbol\nbinary=memprof\n");
+	for (i = 0; i < n; i++)
+		fprintf(fp, "0x%016x %s:%d\n", i + 1, e[i].file, e[i].line);
+	fprintf(fp, "---\n--- heap\n");
+	fprintf(fp, "heap profile: %ld: %ld [%ld: %ld] @ heapprofile\n", nlive, live, nalloc, total);
+	for (i = 0; i < n; i++)
+		fprintf(fp, "%ld: %ld [%ld: %ld] @ 0x%016x\n",
+			e[i].nalloc - e[i].nfree, e[i].allocbytes - e[i].freebytes,
+			e[i].nalloc, e[i].allocbytes, i + 1);
+	free(e);
+}
@@ -0,0 +1,18 @@
+/**
+ * Memprof reports where a program's memory goes. It is the interface to the
+ * profiling implementation of Mem, memprof.c, which is selected at link time like
+ * memchk.c: link memprof.o instead of mem.o. Every ALLOC, CALLOC, NEW and RESIZE
+ * passes its file and line to Mem, and memprof counts the calls and bytes of each
+ * of these call sites and the bytes they still hold.
+ */
+
+#ifndef MEMPROF_INCLUDED
+#define MEMPROF_INCLUDED
+
+#include <stdio.h>
+
+// <exported functions>
+extern void Mem_profile(FILE *fp);
+extern void Mem_pprof(FILE *fp);
+
+#endif
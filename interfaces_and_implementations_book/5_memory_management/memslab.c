@@ -0,0 +1,379 @@
+/**
+ * memslab is a production implementation of the Mem interface for programs that
+ * allocate many small objects, which is what the ADTs in this library do: table
+ * bindings, set members, list cells, ring nodes and atoms are all a few dozen
+ * bytes. It is selected at link time, the way memchk.c is: link memslab.o
+ * instead of mem.o.
+ *
+ * Small blocks are grouped by size class. Each class carves its blocks out of
+ * slabs, SLABSIZE-byte chunks aligned on a SLABSIZE boundary, and keeps the blocks
+ * freed by Mem_free on a free list, so allocating and freeing a small block is a
+ * couple of pointer moves. Blocks carry no header: the class of a block is
+ * recorded once per slab, in a radix map indexed by the address of the slab, and
+ * Mem_free finds it with two array lookups. Blocks larger than the largest class
+ * come from malloc and have no entry in the map.
+ *
+ * The free lists are per-thread magazines. A thread's magazine for a class holds
+ * up to 2*BATCH blocks and is touched only by that thread, so Mem_alloc and
+ * Mem_free take no lock on the fast path. An empty magazine takes a batch of
+ * blocks from the class's shared pool, or carves one from the class's current
+ * slab; a full one gives its older BATCH blocks back to the pool. Batches move
+ * as chains linked through the blocks themselves, so the pool's mutex is held
+ * for a few pointer moves per BATCH allocations. When a thread exits, its
+ * magazines go back to the pools. The radix map is read without locking: a
+ * slab's entry is written before any of its blocks is handed out.
+ *
+ * Slabs are never returned to the system; a program's small-block footprint is
+ * its high-water mark.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "assert.h"
+#include "except.h"
+#include "mem.h"
+
+// <macros>
+
+#define ADDRBITS 48 // bits of a user-space address on current 64-bit systems
+#define SLABBITS 16
+#define SLABSIZE (1L << SLABBITS)
+#define LEAFBITS 16
+#define NCLASSES ((int)(sizeof classes / sizeof classes[0]))
+#define MAXSMALL 1024
+#define ROUND 16
+#define BATCH 32
+
+// <raise Mem_Failed>
+#define FAIL(file, line) do { \
+	if (file == NULL) { RAISE(Mem_Failed); } \
+	else { Except_raise(&Mem_Failed, file, line); } \
+} while (0)
+
+// <data>
+
+const Except_T Mem_Failed = { "Allocation Failed" };
+
+// The block sizes of the classes: multiples of 16 up to 256, so every block is
+// aligned like malloc's, then coarser steps up to MAXSMALL
+static const int classes[] = {
+	16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256,
+	320, 384, 448, 512, 640, 768, 896, 1024
+};
+
+// sizeclass[(n - 1) / ROUND] is the smallest class whose blocks hold n bytes
+static const unsigned char sizeclass[MAXSMALL / ROUND] = {
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+	16, 16, 16, 16, 17, 17, 17, 17, 18, 18, 18, 18, 19, 19, 19, 19,
+	20, 20, 20, 20, 20, 20, 20, 20, 21, 21, 21, 21, 21, 21, 21, 21,
+	22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23
+};
+
+// The shared pool of a class: a list of free batches, and the slab that new
+// blocks are carved from. The first word of a block links it to the next block
+// of its batch, and the second word of a batch's first block links the batch to
+// the next one
+static struct class {
+	pthread_mutex_t lock;
+	void **batches;
+	char *avail; // the unused part of the current slab
+	char *limit;
+} pool[NCLASSES];
+
+// The calling thread's magazines, one per class. count is the number of blocks
+// on free, or an overestimate when a short batch was taken from the pool
+static _Thread_local struct magazine {
+	void **free;
+	int count;
+} magazine[NCLASSES];
+static _Thread_local int enrolled;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key; // runs flush when an enrolled thread exits
+static pthread_mutex_t maplock = PTHREAD_MUTEX_INITIALIZER;
+
+// The radix map: slab address >> SLABBITS is split into a root index and a leaf
+// index, and the leaf entry holds the class of the slab plus one; zero means the
+// address is not in a slab. Leaves are published with a release store, since
+// classof reads root without taking maplock
+static unsigned char *_Atomic root[1L << (ADDRBITS - SLABBITS - LEAFBITS)];
+
+
+// <static functions>
+
+/**
+ * Returns the class of the slab that holds ptr, or -1 if ptr is not in a slab
+ */
+static int classof(const void *ptr){
+	uintptr_t page = (uintptr_t)ptr >> SLABBITS;
+	unsigned char *leaf;
+
+	if ((page >> LEAFBITS) >= sizeof root / sizeof root[0])
+		return -1;
+	leaf = atomic_load_explicit(&root[page >> LEAFBITS], memory_order_acquire);
+	if (leaf == NULL)
+		return -1;
+	return leaf[page & ((1L << LEAFBITS) - 1)] - 1;
+}
+
+/**
+ * Gives the chain of free blocks that starts at chain back to the shared pool of
+ * class c
+ */
+static void release(int c, void **chain){
+	pthread_mutex_lock(&pool[c].lock);
+	chain[1] = pool[c].batches;
+	pool[c].batches = chain;
+	pthread_mutex_unlock(&pool[c].lock);
+}
+
+/**
+ * Gives the magazines of an exiting thread back to the shared pools, cut into
+ * chains of at most BATCH blocks so refill never takes more than it counts. The
+ * last chain of a class may be short, which only means the thread that takes it
+ * comes back to the pool sooner. The thread is no longer enrolled afterwards, so
+ * a block freed by a later thread-exit destructor enrolls it again and this runs
+ * once more
+ */
+static void flush(void *cl){
+	void **b, **chain, **next;
+	int c, n;
+
+	(void)cl;
+	for (c = 0; c < NCLASSES; c++) {
+		for (chain = magazine[c].free; chain; chain = next) {
+			for (b = chain, n = 1; n < BATCH && b[0]; n++)
+				b = b[0];
+			next = b[0];
+			b[0] = NULL;
+			release(c, chain);
+		}
+		magazine[c].free = NULL;
+		magazine[c].count = 0;
+	}
+	enrolled = 0;
+}
+
+/**
+ * Sets up the shared pools, once per process
+ */
+static void init(void){
+	int c;
+
+	for (c = 0; c < NCLASSES; c++)
+		pthread_mutex_init(&pool[c].lock, NULL);
+	pthread_key_create(&key, flush);
+}
+
+/**
+ * Arranges for flush to run when the calling thread exits
+ */
+static void enroll(void){
+	pthread_once(&once, init);
+	pthread_setspecific(key, magazine);
+	enrolled = 1;
+}
+
+/**
+ * Gives class c a new slab and records it in the radix map. Returns zero if the
+ * system is out of memory. The caller holds the lock of class c
+ */
+static int newslab(int c){
+	uintptr_t page;
+	unsigned char *leaf;
+	void *slab;
+
+	if (posix_memalign(&slab, SLABSIZE, SLABSIZE) != 0)
+		return 0;
+	page = (uintptr_t)slab >> SLABBITS;
+	assert((page >> LEAFBITS) < sizeof root / sizeof root[0]);
+	pthread_mutex_lock(&maplock);
+	if ((leaf = root[page >> LEAFBITS]) == NULL) {
+		if ((leaf = calloc(1L << LEAFBITS, 1)) == NULL) {
+			pthread_mutex_unlock(&maplock);
+			free(slab);
+			return 0;
+		}
+		atomic_store_explicit(&root[page >> LEAFBITS], leaf, memory_order_release);
+	}
+	leaf[page & ((1L << LEAFBITS) - 1)] = c + 1;
+	pthread_mutex_unlock(&maplock);
+	pool[c].avail = slab;
+	pool[c].limit = (char *)slab + SLABSIZE/classes[c]*classes[c];
+
+	return 1;
+}
+
+/**
+ * Fills the empty magazine of class c with a batch from the shared pool, or with
+ * up to BATCH blocks carved from the current slab. Only the carved range is
+ * claimed under the lock; its blocks are linked after the lock is released.
+ * Returns zero if the system is out of memory
+ */
+static int refill(int c){
+	struct class *p = &pool[c];
+	struct magazine *m = &magazine[c];
+	char *q;
+	int i, n;
+
+	if (!enrolled)
+		enroll();
+	pthread_mutex_lock(&p->lock);
+	if ((m->free = p->batches) != NULL) {
+		p->batches = m->free[1];
+		pthread_mutex_unlock(&p->lock);
+		m->count = BATCH;
+		return 1;
+	}
+	if (p->avail == p->limit && !newslab(c)) {
+		pthread_mutex_unlock(&p->lock);
+		return 0;
+	}
+	n = (p->limit - p->avail) / classes[c];
+	if (n > BATCH)
+		n = BATCH;
+	q = p->avail;
+	p->avail += n*classes[c];
+	pthread_mutex_unlock(&p->lock);
+
+	for (i = 0; i < n - 1; i++)
+		*(void **)(q + i*classes[c]) = q + (i + 1)*classes[c];
+	*(void **)(q + i*classes[c]) = NULL;
+	m->free = (void **)q;
+	m->count = n;
+
+	return 1;
+}
+
+/**
+ * Gives all but the newest BATCH blocks of the full magazine of class c back to
+ * the shared pool
+ */
+static void drain(int c){
+	struct magazine *m = &magazine[c];
+	void **b = m->free;
+	int n;
+
+	for (n = 1; n < BATCH && b[0]; n++)
+		b = b[0];
+	if (b[0]) {
+		release(c, b[0]);
+		b[0] = NULL;
+	}
+	m->count = n;
+}
+
+
+// <functions>
+
+void *Mem_alloc(long nbytes, const char *file, int line){
+	struct magazine *m;
+	void **ptr;
+	int c;
+
+	assert(nbytes > 0);
+	if (nbytes > MAXSMALL) {
+		if ((ptr = malloc(nbytes)) == NULL)
+			FAIL(file, line);
+		return ptr;
+	}
+
+	c = sizeclass[(nbytes - 1) / ROUND];
+	m = &magazine[c];
+	if (m->free == NULL && !refill(c))
+		FAIL(file, line);
+	ptr = m->free;
+	m->free = ptr[0];
+	m->count--;
+
+	return ptr;
+}
+
+void *Mem_calloc(long count, long nbytes, const char *file, int line){
+	void *ptr;
+
+	assert(count > 0);
+	assert(nbytes > 0);
+	if (count*nbytes > MAXSMALL) {
+		if ((ptr = calloc(count, nbytes)) == NULL)
+			FAIL(file, line);
+		return ptr;
+	}
+	ptr = Mem_alloc(count*nbytes, file, line);
+	memset(ptr, '\0', count*nbytes);
+
+	return ptr;
+}
+
+// Small blocks go into the calling thread's magazine for their class, whichever
+// thread allocated them; anything else came from malloc or posix_memalign
+void Mem_free(void *ptr, const char *file, int line){
+	struct magazine *m;
+	int c;
+
+	(void)file;
+	(void)line;
+	if (ptr == NULL)
+		return;
+	if ((c = classof(ptr)) < 0) {
+		free(ptr);
+		return;
+	}
+
+	m = &magazine[c];
+	*(void **)ptr = m->free;
+	m->free = ptr;
+	if (++m->count >= 2*BATCH)
+		drain(c);
+	else if (!enrolled)
+		enroll();
+}
+
+// A small block that is already big enough is returned as is; otherwise the
+// contents move to a block of the right size
+void *Mem_resize(void *ptr, long nbytes, const char *file, int line){
+	void *newptr;
+	int c;
+
+	assert(ptr);
+	assert(nbytes > 0);
+	if ((c = classof(ptr)) < 0) {
+		if ((newptr = realloc(ptr, nbytes)) == NULL)
+			FAIL(file, line);
+		return newptr;
+	}
+	if (nbytes <= classes[c] && (c == 0 || nbytes > classes[c - 1]))
+		return ptr;
+
+	newptr = Mem_alloc(nbytes, file, line);
+	memcpy(newptr, ptr, nbytes < classes[c] ? nbytes : classes[c]);
+	Mem_free(ptr, file, line);
+
+	return newptr;
+}
+
+// Small blocks are aligned on 16 bytes, so only stricter alignments need a
+// block of their own; Mem_free recognizes it as not belonging to a slab
+void *Mem_alloc_aligned(long nbytes, long align, const char *file, int line){
+	void *ptr = NULL;
+
+	assert(nbytes > 0);
+	assert(align > 0 && (align & (align - 1)) == 0);
+	if (align <= ROUND)
+		return Mem_alloc(nbytes, file, line);
+	if (posix_memalign(&ptr, align, nbytes) != 0)
+		FAIL(file, line);
+
+	return ptr;
+}
+
+// Like mem.c, memslab keeps no record of the blocks it hands out, so it has no
+// leaks to report and never calls apply
+void Mem_leak(void apply(const void *ptr, long size, const char *file, int line, void *cl), void *cl){
+	assert(apply);
+	(void)apply;
+	(void)cl;
+}
@@ -1,5 +1,10 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "assert.h"
 #include "except.h"
 #include "arena.h"
@@ -13,12 +18,57 @@ const Except_T Arena_Failed = { "Arena Allocation Failed" };
 //////////////
 // <macros> //
 //////////////
-#define THRESHOLD 10
+#define CHUNKSIZE (16*1024) // size of the first chunk of an Arena_new arena
+#define MAXSIZE (4L << 20) // chunks grow geometrically up to MAXSIZE
+#define MAXLOCAL (64L << 20) // bytes of free chunks kept by each thread
+#define MAXCACHED (256L << 20) // bytes of free chunks kept for all threads
+#define NCLASSES ((int)(8*sizeof (long)))
+#define NTAKE 8 // chunks a thread takes from an overflow list at a time
 
 /////////////
 // <types> //
 /////////////
 
+/**
+ * Arena struct
+ */
+struct T {
+	T prev; // Points to the head of the chunk
+	char *avail; // Points to the chunk's first free location
+	char *limit; // The space between avail and limit is available for allocation
+	long size; // Size of the next chunk, a power of two
+	struct region *region; // The mapping of an Arena_newmap arena, or null
+};
+
+/**
+ * An Arena_newmap arena allocates from one mapping instead of chunks. The region
+ * descriptor is at the start of the mapping, and avail and limit of the arena span
+ * the rest of it. high is the highest avail that Arena_release has rolled back
+ * from, so Arena_free knows which pages have been touched.
+ */
+struct region {
+	long size; // Size of the mapping
+	int keep; // Nonzero if Arena_free keeps the pages
+	char *high;
+};
+
+/**
+ * Arena_new allocates a struct arena and returns a pointer to its struct T, so the
+ * statistics of an arena are not copied into the header of every chunk. held is
+ * the size of the chunks the arena holds and high the most it ever held; for an
+ * Arena_newmap arena, high is the most of its region it ever used.
+ */
+struct arena {
+	struct T arena;
+	long requested; // Bytes asked for since the last Arena_free
+	long chunks;
+	long held;
+	long high;
+};
+
+#define STATS(arena) ((struct arena *)(arena))
+
+
 /**
  * The size of the union give the minimun alignment on the host machine. Its fields
  * are those thar are most likely to have the strictest alignment requirements, and
@@ -44,22 +94,198 @@ union header {
 	union align a;
 };
 
+////////////
+// <data> //
+////////////
+
 /**
- * Arena struct
+ * Free chunks are kept for reuse in lists by size class: every chunk is a power
+ * of two bytes long, and a list of class k holds free chunks of 2^k bytes, linked
+ * by prev, each with its limit in its header. An arena that is freed and filled
+ * again asks for the same sizes in the same order, so it takes all its chunks
+ * from these lists.
+ *
+ * Each thread has its own lists, freechunks, which hold up to MAXLOCAL bytes, so
+ * a thread that runs its own arenas allocates and frees chunks without locking.
+ * Chunks that do not fit there go to the shared overflow lists, which hold up to
+ * MAXCACHED bytes and are lock-free stacks: a chunk is pushed with a
+ * compare-and-swap, and a thread whose own list is empty takes a whole overflow
+ * list with one exchange, so no chunk is ever popped while another thread
+ * pushes. It keeps up to NTAKE chunks of the list and pushes the rest back, so
+ * one thread does not hoard the cache. A thread is enrolled as soon as its own
+ * lists hold a chunk, and when it exits, its chunks go to the overflow lists.
  */
-struct T {
-	T prev; // Points to the head of the chunk
-	char *avail; // Points to the chunk's first free location
-	char *limit; // The space between avail and limit is available for allocation
-};
+static _Thread_local T freechunks[NCLASSES];
+static _Thread_local long cached;
+static _Thread_local int enrolled;
 
+static _Atomic(T) overflow[NCLASSES];
+static atomic_long overflowed;
 
-////////////
-// <data> //
-////////////
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key; // runs flush when an enrolled thread exits
+
+// Chunk requests of all arenas served from the free lists, and those that
+// called malloc
+static atomic_long hits, misses;
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the smallest k such that 2^k >= n
+ */
+static int classof(long n){
+	int k = 0;
+
+	while ((1L << k) < n)
+		k++;
+	return k;
+}
+
+/**
+ * Returns the first aligned location after the descriptor of region r
+ */
+static char *start(struct region *r){
+	return (char *)r + ((sizeof(*r) + sizeof(union align) - 1) / sizeof(union align)) * sizeof(union align);
+}
+
+/**
+ * Pushes chunk, of class k, on the overflow list of its class, or frees it if
+ * the overflow lists are full
+ */
+static void spill(T chunk, int k){
+	T head;
+
+	if (atomic_fetch_add(&overflowed, 1L << k) + (1L << k) > MAXCACHED) {
+		atomic_fetch_sub(&overflowed, 1L << k);
+		free(chunk);
+		return;
+	}
+	head = atomic_load(&overflow[k]);
+	do
+		chunk->prev = head;
+	while (!atomic_compare_exchange_weak(&overflow[k], &head, chunk));
+}
+
+/**
+ * Gives the free chunks of an exiting thread to the overflow lists. The thread is
+ * no longer enrolled afterwards, so a chunk it keeps in a later thread-exit
+ * destructor enrolls it again and this runs once more
+ */
+static void flush(void *cl){
+	int k;
+
+	(void)cl;
+	for (k = 0; k < NCLASSES; k++)
+		while (freechunks[k]) {
+			T chunk = freechunks[k];
+
+			freechunks[k] = chunk->prev;
+			spill(chunk, k);
+		}
+	cached = 0;
+	enrolled = 0;
+}
+
+/**
+ * Creates key, once per process
+ */
+static void init(void){
+	pthread_key_create(&key, flush);
+}
+
+/**
+ * Arranges for flush to run when the calling thread exits
+ */
+static void enroll(void){
+	pthread_once(&once, init);
+	pthread_setspecific(key, freechunks);
+	enrolled = 1;
+}
+
+/**
+ * Returns a free chunk of class k with its limit in its header, or null if there
+ * is none. When the thread has none of its own, it takes the overflow list of the
+ * class, keeps up to NTAKE chunks of it and pushes the rest back
+ */
+static T getchunk(int k){
+	T chunk = freechunks[k];
 
-static T freechunks;
-static int nfree;
+	if (chunk == NULL) {
+		T p, rest, head;
+		long n = 1L << k;
+
+		if ((chunk = atomic_exchange(&overflow[k], NULL)) == NULL)
+			return NULL;
+		for (p = chunk; p->prev && n < NTAKE*(1L << k); p = p->prev)
+			n += 1L << k;
+		if ((rest = p->prev) != NULL) {
+			p->prev = NULL;
+			for (p = rest; p->prev; p = p->prev)
+				;
+			head = atomic_load(&overflow[k]);
+			do
+				p->prev = head;
+			while (!atomic_compare_exchange_weak(&overflow[k], &head, rest));
+		}
+		atomic_fetch_sub(&overflowed, n);
+		cached += n;
+		if (!enrolled)
+			enroll();
+	}
+	freechunks[k] = chunk->prev;
+	cached -= 1L << k;
+	return chunk;
+}
+
+/**
+ * Keeps chunk, whose limit is limit, for reuse
+ */
+static void putchunk(T chunk, char *limit){
+	long m = limit - (char *)chunk;
+	int k = classof(m);
+
+	chunk->limit = limit;
+	if (cached + m > MAXLOCAL) {
+		spill(chunk, k);
+		return;
+	}
+	if (!enrolled)
+		enroll();
+	chunk->prev = freechunks[k];
+	freechunks[k] = chunk;
+	cached += m;
+}
+
+/**
+ * Frees the chunk arena allocates from and makes the arena allocate from the
+ * chunk before it again
+ */
+static void pop(T arena){
+	struct T tmp = *arena->prev;
+
+	// <free the chunk described by arena>
+	STATS(arena)->chunks--;
+	STATS(arena)->held -= arena->limit - (char *)arena->prev;
+	putchunk(arena->prev, arena->limit);
+	*arena = tmp;
+}
+
+/**
+ * Returns the number of bytes of the region of arena that it has used since it
+ * was last freed, and updates the high-water mark
+ */
+static long touched(T arena){
+	struct region *r = arena->region;
+	long n = (r->high > arena->avail ? r->high : arena->avail) - start(r);
+
+	if (STATS(arena)->high < n)
+		STATS(arena)->high = n;
+	return n;
+}
 
 
 /////////////////
@@ -78,6 +304,8 @@ static int nfree;
  * @return        			Pointer to allocated memory space
  */
 void *Arena_alloc(T arena, long nbytes, const char *file, int line){
+	long requested = nbytes;
+
 	assert(arena);
 	assert(nbytes > 0);
 
@@ -89,30 +317,47 @@ void *Arena_alloc(T arena, long nbytes, const char *file, int line){
 		T ptr;
 		char *limit;
 
+		if (arena->region){
+			// <raise Arena_Failed>: the mapping is full
+			if (file == NULL){ RAISE(Arena_Failed); }
+			else { Except_raise(&Arena_Failed, file, line); }
+		}
+
 		// <ptr <- a new chunk>
-		if ((ptr = freechunks) != NULL){
-			freechunks = freechunks->prev;
-			nfree--;
+		// the chunk holds arena->size bytes, or the smallest power of two that
+		// holds the header and nbytes if that is more
+		int k = classof(sizeof(union header) + nbytes);
+
+		if (k < classof(arena->size))
+			k = classof(arena->size);
+		if ((ptr = getchunk(k)) != NULL){
+			atomic_fetch_add_explicit(&hits, 1, memory_order_relaxed);
 			limit = ptr->limit;
 		} else {
-			long m = sizeof(union header) + nbytes + 10*1024;
-			ptr = malloc(m);
+			atomic_fetch_add_explicit(&misses, 1, memory_order_relaxed);
+			ptr = malloc(1L << k);
 			if (ptr == NULL){
 				// <raise Arena_Failed>
 				if (file == NULL){ RAISE(Arena_Failed); }
 				else { Except_raise(&Arena_Failed, file, line); }
 
 			}
-			limit = (char *)ptr + m;
+			limit = (char *)ptr + (1L << k);
 		}
 		
 		*ptr = *arena;
 		arena->avail = (char *)((union header *)ptr + 1);
 		arena->limit = limit;
 		arena->prev = ptr;
+		if (arena->size < MAXSIZE)
+			arena->size *= 2;
+		STATS(arena)->chunks++;
+		if ((STATS(arena)->held += 1L << k) > STATS(arena)->high)
+			STATS(arena)->high = STATS(arena)->held;
 	}
 
 	arena->avail += nbytes;
+	STATS(arena)->requested += requested;
 	return arena->avail - nbytes;
 }
 
@@ -143,38 +388,93 @@ void *Arena_calloc(T arena, long count, long nbytes, const char *file, int line)
 void Arena_dispose(T *ap) {
 	assert(ap && *ap);
 	Arena_free(*ap);
+	if ((*ap)->region)
+		munmap((*ap)->region, (*ap)->region->size);
 	free(*ap);
 	*ap = NULL;
 }
 
 /**
- * Frees teh allocated chunks space of an arena. If the number of free arenas is lower than
- * THRESHOLD the pointer to the begining of the memory block, otherwise it'll calls free()
+ * Frees the allocated chunks space of an arena. Each chunk goes on the calling thread's
+ * free list for its size class, or on the shared overflow list when the thread keeps
+ * MAXLOCAL bytes already; when both are full it's passed to free(). The arena goes back
+ * to the state Arena_new left it in, so its next chunk has the initial size again.
  * 
  * @param {T} arena Arena structure to deallocate
  */
 void Arena_free(T arena) {
 	assert(arena);
-	while (arena->prev) {
-		struct T tmp = *arena->prev;
-
-		// <free the chunk described by arena>
-		if (nfree < THRESHOLD) {
-			arena->prev->prev = freechunks;
-			freechunks = arena->prev;
-			nfree++;
-			freechunks->limit = arena->limit;
-		} else {
-			free(arena->prev);
-		}
-		
-		*arena = tmp;
+	if (arena->region) {
+		struct region *r = arena->region;
+		long pagesize = sysconf(_SC_PAGESIZE);
+		char *high = r->high > arena->avail ? r->high : arena->avail;
+		char *first = (char *)r + pagesize; // the page of the descriptor stays
+
+		// <give the touched pages back unless they are kept>
+		touched(arena);
+		if (!r->keep && high > first)
+			madvise(first, (high - first + pagesize - 1) / pagesize * pagesize, MADV_DONTNEED);
+		arena->avail = start(r);
+		r->high = arena->avail;
+		STATS(arena)->requested = 0;
+		return;
 	}
+	while (arena->prev)
+		pop(arena);
+	STATS(arena)->requested = 0;
 	assert(arena->limit == NULL);
 	assert(arena->avail == NULL);
 }
 
 
+/**
+ * Returns a checkpoint of arena. Arena_release(arena, mark) deallocates everything
+ * allocated in arena after the checkpoint and leaves the rest, so an arena can hold
+ * scratch allocations that are rolled back while longer-lived ones stay.
+ *
+ * @param  {T} arena   Arena structure
+ * @return     Checkpoint of arena
+ */
+Arena_Mark Arena_mark(T arena){
+	Arena_Mark mark;
+
+	assert(arena);
+	mark.arena = arena;
+	mark.chunk = arena->prev;
+	mark.avail = arena->avail;
+	mark.requested = STATS(arena)->requested;
+	return mark;
+}
+
+/**
+ * Deallocates the space allocated in arena after mark was taken: the chunks added
+ * since then are freed as by Arena_free, and allocation resumes in the chunk of the
+ * mark, where it was when the mark was taken. It takes time proportional to the
+ * number of chunks freed. Marks taken after mark are no longer valid. It's a checked
+ * runtime error to release to a mark of another arena, caught before anything is
+ * freed. It's an unchecked runtime error to release to a mark that an earlier
+ * Arena_release or Arena_free has gone past: a freed chunk may be reused at the
+ * same address, and then the stale mark looks like a valid one.
+ *
+ * @param {T} arena   Arena structure
+ * @param {Arena_Mark} mark   Checkpoint returned by Arena_mark
+ */
+void Arena_release(T arena, Arena_Mark mark){
+	assert(arena);
+	assert(mark.arena == arena);
+	if (arena->region) {
+		touched(arena);
+		if (arena->region->high < arena->avail)
+			arena->region->high = arena->avail;
+	}
+	while (arena->prev && arena->prev != mark.chunk)
+		pop(arena);
+	assert(arena->prev == mark.chunk);
+	assert(mark.avail <= arena->avail);
+	arena->avail = mark.avail;
+	STATS(arena)->requested = mark.requested;
+}
+
 /**
  * Allocates and returns an arena structure with it's fields set to null pointers
  * which denotes an empty arena
@@ -182,14 +482,115 @@ void Arena_free(T arena) {
  * @return New allocated arena structure
  */
 T Arena_new(void){
-	T arena = malloc(sizeof(*arena));
+	return Arena_newsize(CHUNKSIZE);
+}
+
+/**
+ * Like Arena_new, but the first chunk of the arena holds chunksize bytes, rounded up
+ * to a power of two, instead of CHUNKSIZE. Each later chunk is twice the size of the
+ * one before, up to MAXSIZE, so an arena that grows large needs few chunks. Arenas
+ * that are known to grow large start with a large chunk.
+ *
+ * @param  {long} chunksize   Size of the first chunk of the arena
+ * @return New allocated arena structure
+ */
+T Arena_newsize(long chunksize){
+	T arena;
 
+	assert(chunksize > 0);
+	arena = calloc(1, sizeof(struct arena));
 	if (arena == NULL)
 		RAISE(Arena_NewFailed);
 
 	arena->prev = NULL;
 	arena->limit = arena->avail = NULL;
+	arena->size = 1L << classof(chunksize);
+	arena->region = NULL;
 	return arena;
 }
 
+/**
+ * Allocates and returns an arena that allocates from a single region of nbytes of
+ * address space instead of chunks, for arenas that grow to gigabytes. The region is
+ * reserved with mmap but not committed: its pages cost memory only once they are
+ * touched, and transparent huge pages are requested for it where the system has
+ * them. Every allocation is a pointer bump, and allocating more than the region
+ * holds raises Arena_Failed. Arena_free gives the touched pages back to the system
+ * with madvise(MADV_DONTNEED), unless keep is nonzero, in which case they stay
+ * committed and warm for the next use of the arena. Arena_dispose unmaps the region.
+ *
+ * @param  {long} nbytes   Size of the region
+ * @param  {int} keep   Nonzero to keep the pages when the arena is freed
+ * @return New allocated arena structure
+ */
+T Arena_newmap(long nbytes, int keep){
+	long pagesize = sysconf(_SC_PAGESIZE);
+	struct region *r;
+	T arena;
 
+	assert(nbytes > 0);
+	nbytes = (nbytes + sizeof(struct region) + sizeof(union align) + pagesize - 1) / pagesize * pagesize;
+	r = mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (r == MAP_FAILED)
+		RAISE(Arena_NewFailed);
+#ifdef MADV_HUGEPAGE
+	madvise(r, nbytes, MADV_HUGEPAGE);
+#endif
+	if ((arena = calloc(1, sizeof(struct arena))) == NULL) {
+		munmap(r, nbytes);
+		RAISE(Arena_NewFailed);
+	}
+
+	r->size = nbytes;
+	r->keep = keep;
+	arena->prev = NULL;
+	arena->avail = start(r);
+	arena->limit = (char *)r + nbytes;
+	arena->size = 0;
+	arena->region = r;
+	r->high = arena->avail;
+	return arena;
+}
+
+/**
+ * Fills in *stats with the statistics of arena and the counters of the chunk cache.
+ * requested is the number of bytes asked for since the arena was last freed or
+ * released, and used is the number of bytes handed out for them, which is larger
+ * because of alignment. chunks and size are the number and total size of the chunks
+ * the arena holds; waste is the part of them lost to alignment, to chunk headers
+ * and to the ends of chunks too small for the allocation that followed, and high is
+ * the most the arena has held at once. For an Arena_newmap arena, chunks is zero,
+ * size is the size of its region, waste counts only alignment, and high is the most
+ * of the region it has used. hits and misses count the chunk requests of all arenas
+ * that were served from the cache of free chunks and those that called malloc.
+ *
+ * @param {T} arena   Arena structure
+ * @param {Arena_Stats *} stats   Statistics to fill in
+ */
+void Arena_stats(T arena, Arena_Stats *stats){
+	struct T cur;
+
+	assert(arena);
+	assert(stats);
+	stats->requested = STATS(arena)->requested;
+	stats->chunks = STATS(arena)->chunks;
+	stats->hits = atomic_load_explicit(&hits, memory_order_relaxed);
+	stats->misses = atomic_load_explicit(&misses, memory_order_relaxed);
+	if (arena->region) {
+		touched(arena);
+		stats->used = arena->avail - start(arena->region);
+		stats->size = arena->region->size;
+		stats->waste = stats->used - stats->requested;
+		stats->high = STATS(arena)->high;
+		return;
+	}
+
+	// each chunk's header holds the state of the arena when the chunk was added,
+	// which tells how far the chunk before it was used
+	stats->used = 0;
+	for (cur = *arena; cur.prev; cur = *cur.prev)
+		stats->used += cur.avail - (char *)((union header *)cur.prev + 1);
+	stats->size = STATS(arena)->held;
+	stats->waste = stats->size - stats->requested - (arena->limit - arena->avail);
+	stats->high = STATS(arena)->high;
+}
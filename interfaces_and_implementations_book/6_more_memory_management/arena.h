@@ -24,16 +24,47 @@
 #define T Arena_T
 typedef struct T *T;
 
+/**
+ * A checkpoint in an arena: the arena, and the chunk being allocated from and the
+ * position in it when Arena_mark was called
+ */
+typedef struct Arena_Mark {
+	T arena;
+	T chunk;
+	char *avail;
+	long requested;
+} Arena_Mark;
+
+/**
+ * The statistics of an arena, filled in by Arena_stats
+ */
+typedef struct Arena_Stats {
+	long requested; // bytes asked for since the arena was last freed
+	long used; // bytes handed out for them, with alignment
+	long waste; // bytes of the chunks lost to alignment, headers and chunk ends
+	long chunks; // chunks the arena holds
+	long size; // bytes of those chunks
+	long high; // the most bytes the arena has held at once
+	long hits, misses; // chunk requests of all arenas served by the chunk cache, or not
+} Arena_Stats;
+
 extern const Except_T Arena_NewFailed;
 extern const Except_T Arena_Failed;
 
 // <exported functions>
 extern T Arena_new(void);
+extern T Arena_newsize(long chunksize);
+extern T Arena_newmap(long nbytes, int keep);
 extern void Arena_dispose(T *ap);
 
 extern void *Arena_alloc(T arena, long nbytes, const char *file, int line);
 extern void *Arena_calloc(T arena, long count, long nbytes, const char *file, int line);
 extern void Arena_free(T arena);
 
+extern Arena_Mark Arena_mark(T arena);
+extern void Arena_release(T arena, Arena_Mark mark);
+
+extern void Arena_stats(T arena, Arena_Stats *stats);
+
 #undef T
 #endif
\ No newline at end of file
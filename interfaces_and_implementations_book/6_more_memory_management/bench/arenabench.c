@@ -0,0 +1,81 @@
+/**
+ * arenabench fills an arena with many small allocations, frees it and fills it
+ * again, the way a server uses one arena per request, and reports the time per
+ * cycle. The first cycle gets its chunks from malloc; later cycles should find
+ * them all in the chunk cache.
+ *
+ * 		arenabench [nbytes [ncycles]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "assert.h"
+#include "arena.h"
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the wall clock time in seconds
+ */
+static double now (void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Allocates about nbytes from arena in blocks of 8 to 135 bytes
+ */
+static void fill (Arena_T arena, long nbytes) {
+	long n;
+	unsigned r = 1;
+
+	for (n = 0; n < nbytes; ) {
+		long size = 8 + (r >> 8) % 128;
+		char *p = Arena_alloc(arena, size, __FILE__, __LINE__);
+
+		p[0] = p[size - 1] = 1;
+		n += size;
+		r = r * 1103515245 + 12345;
+	}
+}
+
+
+//////////
+// main //
+//////////
+
+int main (int argc, char *argv[]) {
+	long nbytes = 32L << 20;
+	int i, ncycles = 20;
+	Arena_T arena = Arena_new();
+	double t, first = 0, rest = 0;
+
+	if (argc >= 2)
+		nbytes = atol(argv[1]);
+	if (argc >= 3)
+		ncycles = atoi(argv[2]);
+	assert(nbytes > 0 && ncycles > 1);
+
+	for (i = 0; i < ncycles; i++) {
+		t = now();
+		fill(arena, nbytes);
+		Arena_free(arena);
+		t = now() - t;
+		if (i == 0)
+			first = t;
+		else
+			rest += t;
+	}
+	printf("%ld bytes: first cycle %.2f ms, later cycles %.2f ms\n",
+		nbytes, first * 1e3, rest / (ncycles - 1) * 1e3);
+
+	Arena_dispose(&arena);
+	return EXIT_SUCCESS;
+}
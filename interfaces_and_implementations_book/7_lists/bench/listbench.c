@@ -0,0 +1,99 @@
+/**
+ * listbench measures traversals of a list whose cells are scattered over the heap,
+ * as they are after a program has pushed and freed cells for a while, and of the
+ * same list after List_compact has copied its cells into contiguous memory.
+ *
+ * 		listbench [n]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "assert.h"
+#include "arena.h"
+#include "list.h"
+#include "mem.h"
+
+
+//////////////////////
+// static functions //
+//////////////////////
+
+/**
+ * Returns the wall clock time in seconds
+ */
+static double now (void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Adds the value of a cell to the sum pointed to by cl
+ */
+static void add (void **x, void *cl) {
+	*(long *)cl += (long)*x;
+}
+
+
+/**
+ * Times List_length, List_map and two List_reverse calls on list
+ */
+static void run (const char *name, List_T list) {
+	double t0, t1, t2, t3;
+	long sum = 0;
+	int n;
+
+	t0 = now();
+	n = List_length(list);
+	t1 = now();
+	List_map(list, add, &sum);
+	t2 = now();
+	list = List_reverse(List_reverse(list));
+	t3 = now();
+	printf("%-10s length %7.1f ms  map %7.1f ms  reverse %7.1f ms  (n=%d sum=%ld)\n",
+		name, (t1 - t0) * 1e3, (t2 - t1) * 1e3, (t3 - t2) * 1e3, n, sum);
+}
+
+
+//////////
+// main //
+//////////
+
+int main (int argc, char *argv[]) {
+	int i, n = 2000000;
+	List_T list = NULL, compact;
+	List_T *cells;
+	Arena_T arena = Arena_new();
+
+	if (argc >= 2)
+		n = atoi(argv[1]);
+	assert(n > 1);
+
+	// allocate the cells, then link them in a random order
+	cells = ALLOC(n * sizeof (*cells));
+	for (i = 0; i < n; i++)
+		cells[i] = List_push(NULL, (void *)(long)i);
+	srand(1);
+	for (i = n - 1; i > 0; i--) {
+		int j = rand() % (i + 1);
+		List_T tmp = cells[i];
+		cells[i] = cells[j];
+		cells[j] = tmp;
+	}
+	for (i = 0; i < n; i++) {
+		cells[i]->rest = list;
+		list = cells[i];
+	}
+	FREE(cells);
+
+	run("scattered", list);
+	compact = List_compact(arena, list);
+	run("compact", compact);
+
+	List_free(&list);
+	Arena_dispose(&arena);
+	return EXIT_SUCCESS;
+}
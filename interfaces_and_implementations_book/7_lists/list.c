@@ -2,10 +2,39 @@
 #include <stddef.h>
 #include "assert.h"
 #include "mem.h"
+#include "arena.h"
 #include "list.h"
 
 #define T List_T
 
+// <macros>
+
+#define ANEW(arena, p) ((p) = Arena_alloc((arena), (long)sizeof *(p), __FILE__, __LINE__))
+
+// <static functions>
+
+/**
+ * Merges the sorted lists a and b by relinking their nodes. Nodes of a come first
+ * among equal values, which keeps List_sort stable.
+ */
+static T merge (T a, T b, int cmp(const void *x, const void *y)) {
+	T head, *p = &head;
+
+	while (a && b) {
+		if (cmp(b->first, a->first) < 0) {
+			*p = b;
+			b = b->rest;
+		} else {
+			*p = a;
+			a = a->rest;
+		}
+		p = &(*p)->rest;
+	}
+	*p = a ? a : b;
+
+	return head;
+}
+
 // <functions>
 
 /**
@@ -24,6 +53,103 @@ T List_append (T list, T tail){
 	return list;
 }
 
+/**
+ * Like List_copy, but the cells of the copy are allocated in arena. They are
+ * deallocated all at once by Arena_free or Arena_dispose, and must not be passed
+ * to List_free or List_pop.
+ *
+ * @param  {Arena_T} arena   Arena to allocate the cells in
+ * @param  {T} list   List to be copied
+ * @return     Copy of list
+ */
+T List_acopy (Arena_T arena, T list) {
+	T head, *p = &head;
+
+	assert(arena);
+	for ( ; list; list = list->rest) {
+		ANEW(arena, *p);
+		(*p)->first = list->first;
+		p = &(*p)->rest;
+	}
+	*p = NULL;
+
+	return head;
+}
+
+/**
+ * Like List_list, but the cells are allocated in arena. They are deallocated all
+ * at once by Arena_free or Arena_dispose, and must not be passed to List_free or
+ * List_pop.
+ *
+ * @param {Arena_T} arena   Arena to allocate the cells in
+ * @param {void *} x   Pointer to element to include in list
+ * @param {va_arg} ... Variable argument pointers to be included in list
+ */
+T List_alist (Arena_T arena, void *x, ...) {
+	va_list ap;
+	T list, *p = &list;
+
+	assert(arena);
+	va_start(ap, x);
+	for ( ; x; x = va_arg(ap, void *)) {
+		ANEW(arena, *p);
+		(*p)->first = x;
+		p = &(*p)->rest;
+	}
+	*p = NULL;
+	va_end(ap);
+	return list;
+}
+
+/**
+ * Like List_push, but the new cell is allocated in arena. Lists built this way
+ * cost one pointer bump per cell and are dropped with a single Arena_free; drop
+ * cells from the front with list = list->rest instead of List_pop.
+ *
+ * @param  {Arena_T} arena   Arena to allocate the cell in
+ * @param  {T} list   List pointer to push x
+ * @param  {void *} x   Value to push into list
+ * @return      New list that holds x at the beginning
+ */
+T List_apush (Arena_T arena, T list, void *x) {
+	T p;
+
+	assert(arena);
+	ANEW(arena, p);
+	p->first = x;
+	p->rest = list;
+	return p;
+}
+
+/**
+ * Copies the cells of list into one contiguous block allocated in arena, in list
+ * order, and returns the copy. Traversing the copy walks memory sequentially, so
+ * hardware prefetchers hide the cache misses that scattered cells cause. list is
+ * left unchanged; clients that no longer need it release it as usual, with
+ * List_free or with its own arena. Like the cells of List_acopy, the cells of the
+ * copy must not be passed to List_free or List_pop.
+ *
+ * @param  {Arena_T} arena   Arena to allocate the cells in
+ * @param  {T} list   List to be compacted
+ * @return     Copy of list whose cells are contiguous
+ */
+T List_compact (Arena_T arena, T list) {
+	int i, n = List_length(list);
+	T cells;
+
+	assert(arena);
+	if (n == 0)
+		return NULL;
+	cells = Arena_alloc(arena, n * (long)sizeof (*cells), __FILE__, __LINE__);
+	for (i = 0; i < n; i++, list = list->rest) {
+		cells[i].first = list->first;
+		cells[i].rest = &cells[i + 1];
+	}
+	cells[n - 1].rest = NULL;
+
+	return cells;
+}
+
 /**
  * Makes and returns a copy of list
  * @param  {T} list   List to be copied
@@ -167,6 +293,41 @@ T List_reverse (T list) {
 	return head;
 }
 
+/**
+ * Sorts list in place by relinking its nodes and returns the sorted list. cmp
+ * compares two values of the list and returns an integer less than, equal to, or
+ * greater than zero, like strcmp. The sort is stable and allocates nothing: it is a
+ * bottom-up merge sort in which bins[i] holds a sorted run of 2^i nodes.
+ *
+ * @param  {T} list   List to be sorted
+ * @param  {function} cmp   Function that compares two values of list
+ * @return     Sorted list
+ */
+T List_sort (T list, int cmp(const void *x, const void *y)) {
+	T bins[8*sizeof(long)], run;
+	int i, n = 0;
+
+	assert(cmp);
+	while (list) {
+		run = list;
+		list = list->rest;
+		run->rest = NULL;
+		for (i = 0; i < n && bins[i]; i++) {
+			run = merge(bins[i], run, cmp);
+			bins[i] = NULL;
+		}
+		bins[i] = run;
+		if (i == n)
+			n++;
+	}
+
+	for (run = NULL, i = 0; i < n; i++)
+		if (bins[i])
+			run = merge(bins[i], run, cmp);
+
+	return run;
+}
+
 /**
  * Creates an array in which elements zero through N-1 hold the N values from the first
  * field of the list and the Nth element holds the value of end, which is often the null
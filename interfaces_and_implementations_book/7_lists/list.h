@@ -7,6 +7,8 @@
 #ifndef LIST_INCLUDED
 #define LIST_INCLUDED
 
+#include "arena.h"
+
 #define T List_T
 typedef struct T *T;
 
@@ -22,10 +24,17 @@ extern T 		List_list 	(void *x, ...);
 extern T 		List_pop 	(T list, void **x);
 extern T 		List_push 	(T list, void *x);
 extern T 		List_reverse(T list);
+extern T 		List_sort	(T list, int cmp(const void *x, const void *y));
 extern int 		List_length (T list);
 extern void		List_free 	(T *list);
 extern void 	List_map	(T list, void apply(void **x, void *cl), void *cl);
 extern void	  **List_toArray(T list, void *end);
 
+// <arena-allocated lists>
+extern T 		List_acopy	(Arena_T arena, T list);
+extern T 		List_compact(Arena_T arena, T list);
+extern T 		List_alist	(Arena_T arena, void *x, ...);
+extern T 		List_apush	(Arena_T arena, T list, void *x);
+
 #undef T
 #endif
\ No newline at end of file